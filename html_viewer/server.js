@@ -24,6 +24,12 @@ const server = createServer((req, res) => {
     let contentType = 'text/html';
     if (filePath.endsWith('.js')) {
       contentType = 'text/javascript';
+    } else if (filePath.endsWith('.dzi')) {
+      contentType = 'application/xml';
+    } else if (filePath.endsWith('.png')) {
+      contentType = 'image/png';
+    } else if (filePath.endsWith('.jpg') || filePath.endsWith('.jpeg')) {
+      contentType = 'image/jpeg';
     }
 
     // Read the file and send its content as the response
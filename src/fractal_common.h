@@ -0,0 +1,1705 @@
+// Code shared by parallel_combined_mandelbrot.c and parallel_combined_julia_sets.c: fixed-point and
+// double-double arithmetic, the row and tile schedules, colouring and the file output around the encoders
+// of image_encoder.h. Each program is one translation unit that includes image_encoder.h and then this
+// file exactly once, after its configuration #defines, because the code is sized by WIDTH, HEIGHT,
+// MAX_ITERATION and the other settings. Everything defined here is static, so the header cannot be
+// compiled into a second file with other settings by mistake. The program defines the fractal-specific
+// functions declared at the end of the prototypes below (map_to_color, the reference orbit).
+#ifndef FRACTAL_COMMON_H
+#define FRACTAL_COMMON_H
+
+// Helpers called from inside the SIMD kernels (lane refill, double-double arithmetic) are always inlined,
+// so each kernel runs them as code built for its own target. A call into SSE code built for the base
+// target would cost an AVX transition on every pixel
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+
+// STREAM_ROWS bounds what rank 0 holds only when the ranks' rows come in whole rows. Tiles are
+// assembled whole on rank 0, unless MPI-IO writes them in place
+#if STREAM_ROWS > 0 && !GIGAPIXEL_MODE && !(MPI_IO_OUTPUT == 2 || (MPI_IO_OUTPUT == 1 && TILE_WIDTH % 16 == 0 && TILE_HEIGHT % 16 == 0)) \
+    && TILE_DECOMPOSITION && !DEEP_ZOOM && !MARIANI_SILVER
+#error "STREAM_ROWS needs rows, not TILE_DECOMPOSITION"
+#endif
+
+typedef struct {
+    double real;
+    double imag;
+} Complex;
+
+// Fixed-point number: limb[0] is the integer part, limb[i] the i-th 32 bits after the point
+typedef struct {
+    int negative;
+    uint32_t limb[DEEP_ZOOM_LIMBS];
+} Fixed;
+
+// Reference orbit of the deep zoom engine, rounded to double
+typedef struct {
+    int length;         // Last iteration stored; below MAX_ITERATION when the reference escaped
+    double *real;       // Orbit, length + 1 points
+    double *imag;
+    int skip;           // Iterations skipped with the series approximation
+    Complex series[3];  // Series coefficients A, B, C at iteration skip
+} ReferenceOrbit;
+
+// The double-double kernels keep 8 pixels in GCC vector types, which each target
+// compiles to its widest registers (one zmm, two ymm or four xmm per vector)
+#ifdef __GNUC__
+#define DOUBLE_DOUBLE_KERNELS
+#define DOUBLE_DOUBLE_LANES 8
+typedef double DoubleLanes __attribute__((vector_size(DOUBLE_DOUBLE_LANES * sizeof(double))));
+typedef long long LaneMask __attribute__((vector_size(DOUBLE_DOUBLE_LANES * sizeof(long long))));
+
+// Double-double number per lane, hi + lo with |lo| at most half an ulp of hi
+typedef struct {
+    DoubleLanes hi;
+    DoubleLanes lo;
+} DoubleDoubleLanes;
+#endif
+
+// Rectangle of pixels in a rank's block of rows, corners included
+typedef struct {
+    int x0, y0;
+    int x1, y1;
+} Rectangle;
+
+// Tile of the image in tile decomposition mode. Tiles are numbered row by row from the top left
+typedef struct {
+    int x, y;           // Top left pixel
+    int width, height;  // TILE_WIDTH x TILE_HEIGHT, less at the right and bottom edges
+} Tile;
+
+// Tiles still to compute for one worker thread: front to back - 1, in tile order.
+// The owner takes tiles from the front and other threads steal from the back
+typedef struct {
+    pthread_mutex_t lock;
+    int front;
+    int back;
+} TileDeque;
+
+// Pixels of one image row that are contiguous both in a rank's buffer and in the MPI_IO_OUTPUT file
+typedef struct {
+    long long offset;       // Byte offset in the file
+    const int *pixels;
+    int length;             // Pixels
+} FileRun;
+
+static int gigapixel_chunk_rows(void);
+static int mariani_silver_is_leaf(Rectangle rectangle);
+static int mariani_silver_guard_sample(Rectangle rectangle, int sample, int *x, int *y);
+static void mariani_silver_queue(int width, int *result, int x, int y, int **pixels, int *pixel_count, int *pixel_capacity);
+static Fixed fixed_from_double(double value);
+static Fixed fixed_from_string(const char *text);
+static double fixed_to_double(Fixed value);
+static Fixed fixed_add(Fixed a, Fixed b);
+static Fixed fixed_sub(Fixed a, Fixed b);
+static Fixed fixed_mul(Fixed a, Fixed b);
+static Complex complex_add(Complex a, Complex b);
+static Complex complex_mul(Complex a, Complex b);
+static double complex_abs(Complex a);
+static Complex series_delta(const Complex *coefficients, Complex offset);
+static void prepare_reference_orbit(int rank, ReferenceOrbit *reference);
+static int view_needs_double_double(void);
+#ifdef DOUBLE_DOUBLE_KERNELS
+KERNEL_INLINE void two_sum_lanes(const DoubleLanes *a, const DoubleLanes *b, DoubleLanes *sum, DoubleLanes *error);
+KERNEL_INLINE void two_product_lanes(const DoubleLanes *a, const DoubleLanes *b, DoubleLanes *product, DoubleLanes *error);
+KERNEL_INLINE void double_double_add(DoubleDoubleLanes *sum, const DoubleDoubleLanes *a, const DoubleDoubleLanes *b);
+KERNEL_INLINE void double_double_mul(DoubleDoubleLanes *product, const DoubleDoubleLanes *a, const DoubleDoubleLanes *b);
+KERNEL_INLINE void double_double_coordinates(DoubleDoubleLanes *coordinate, double minimum, double maximum, int steps, const DoubleLanes *index);
+KERNEL_INLINE int lanes_any(const LaneMask *mask);
+KERNEL_INLINE void lanes_replace(DoubleLanes *lanes, const LaneMask *mask, const DoubleLanes *other);
+#endif
+static MPI_Win open_work_counter(void);
+static int take_from_counter(MPI_Win counter, int amount);
+static int *block_cyclic_chunk_rows(int rank, int size, int unique_rows, int *chunk_count);
+static int row_chunk_length(int start_row, int unique_rows);
+static void place_row_chunks(int *image, int unique_rows, const int *rows, const int *chunk_rows, int chunk_count);
+static MPI_Datatype row_chunks_type(int unique_rows, const int *chunk_rows, int chunk_count);
+static int tile_total(int unique_rows);
+static Tile image_tile(int index, int unique_rows);
+static int *assigned_tiles(int rank, int size, int unique_rows, int *tile_count);
+static void place_tiles(int *image, int unique_rows, const int *pixels, const int *tiles, int tile_count);
+static MPI_Datatype tiles_type(int unique_rows, const int *tiles, int tile_count);
+static void split_rows_by_cost(const double *row_costs, int unique_rows, int rank, int size, int *start_row, int *end_row);
+static void build_color_table(int png_output);
+static int palette_index(const png_byte *rgba);
+static void pack_png_pixels(const png_byte *pixels, png_bytep row);
+static int pixel_color(int iteration);
+static void color_pixels(const int *iterations, int *pixels, int pixel_count);
+static void color_pixels_scalar(const int *iterations, int *pixels, int pixel_count);
+#ifdef X86_KERNELS
+static __attribute__((target("avx2"))) void color_pixels_avx2(const int *iterations, int *pixels, int pixel_count);
+static __attribute__((target("avx512f"))) void color_pixels_avx512(const int *iterations, int *pixels, int pixel_count);
+#endif
+static int write_dzi_pyramid(const char *filename, unsigned char *strip, int start_row, int end_row, int rank, int size);
+static unsigned char *exchange_level_rows(const unsigned char *rows, int width, const int *ranges, int rank, int size);
+static int write_dzi_tiles(const char *directory, int level, const unsigned char *rows, int width, int height, int first_row, int start_tile_row, int end_tile_row);
+static void downsample_level_rows(const unsigned char *rows, int width, int height, int first_row, int start, int end, unsigned char *next_rows);
+static void write_image_rows(ImageEncoder *encoder, const int *array, int rows, png_bytep row_data, unsigned long long *current_pixel);
+static void send_streamed_rows(const int *array, int rows);
+static int chunk_mirror_rows(int start_row, int unique_rows, int *mirror_start);
+static void send_streamed_chunks(const int *rows, const int *chunk_rows, int chunk_count, const int *mirror_rows, int unique_rows);
+static void write_streamed_chunks(ImageEncoder *encoder, int size, int unique_rows, int symmetric, const int *rows, const int *chunk_rows,
+                                  int chunk_count, const int *mirror_rows, png_bytep row_data, unsigned long long *current_pixel);
+static void write_streamed_strips(ImageEncoder *encoder, int size, const int *rows, int row_count, const int *mirror_rows, int mirror_row_count,
+                           png_bytep row_data, unsigned long long *current_pixel);
+static inline __attribute__((always_inline)) png_byte filtered_png_byte(int filter, int value, int left, int above, int above_left);
+static void filter_png_row(const png_byte *row, const png_byte *previous, int filters, png_byte *filtered);
+static unsigned char *deflate_png_rows(const int *array, int rows, int *length, unsigned long *adler);
+static void send_png_segment(const int *array, int rows);
+static int write_png_chunk(FILE *fp, const char *type, const unsigned char *data, size_t length);
+static int write_png_segment(FILE *fp, const int *array, int rows, int source, unsigned long *adler);
+static void put_little_endian(unsigned char *bytes, unsigned long long value, int length);
+static long long output_header_size(void);
+static long long output_file_size(void);
+static unsigned char *output_header(long long *length);
+static void add_file_runs(FileRun **runs, int *run_count, int *capacity, int row, int x, int length, const int *pixels);
+static int compare_file_runs(const void *a, const void *b);
+static FileRun *local_file_runs(int unique_rows, int tiled, int start_row, int end_row, const int *pixels, const int *tiles, int tile_count,
+                         const int *chunk_rows, int chunk_count, int mirror_start, int mirror_end, const int *mirror_pixels, int *run_count);
+static int open_output_file(const char *filename, MPI_File *file);
+static int write_file_runs(MPI_File file, const FileRun *runs, int run_count);
+
+// Defined by each program
+void compute_reference_orbit(Fixed reference_real, Fixed reference_imag, ReferenceOrbit *reference);
+void compute_series_approximation(ReferenceOrbit *reference, double half_width, double half_height);
+void map_to_color(int iteration, int *red, int *green, int *blue, int color_choice);
+double hue_to_rgb(double hue, double saturation, double lightness);
+
+// Pixels this rank marked as inside through PERIODICITY_CHECK. Thread-local, so worker threads
+// count without locks. The main thread adds their counts to its own after joining them
+static _Thread_local long long periodicity_resolved_pixels = 0;
+
+// References this rank computed for glitched pixels, and glitched pixels left over when it ran out of them
+static long long deep_zoom_extra_references = 0;
+static long long deep_zoom_unresolved_glitches = 0;
+
+// Pixels this rank filled from a uniform rectangle border, and guard samples that disagreed with their border
+static long long mariani_silver_filled_pixels = 0;
+static long long mariani_silver_guard_failures = 0;
+
+// Packed RGBA pixel of every iteration count for COLOR_CHOICE, filled once by build_color_table
+static int color_table[MAX_ITERATION + 1];
+
+// Bytes per pixel of PNG output, set by build_color_table with the colour type and palette of image_encoder.h
+static int png_pixel_bytes = 4;
+
+// Levels and tiles of the DZI pyramid, and the time this rank spent building it
+static int dzi_levels = 0;
+static long long dzi_tiles = 0;
+static double dzi_time = 0.0;
+
+// Colour stage that maps iteration counts through color_table, chosen with the row kernel at startup
+static void (*color_kernel)(const int *iterations, int *pixels, int pixel_count) = color_pixels_scalar;
+
+static int gigapixel_chunk_rows(void) {
+
+    // Every chunk goes out as one message, so it must stay below 2^31 pixels
+    return GIGAPIXEL_CHUNK_ROWS < INT_MAX / WIDTH ? GIGAPIXEL_CHUNK_ROWS : INT_MAX / WIDTH;
+}
+
+static int mariani_silver_is_leaf(Rectangle rectangle) {
+
+    // Rectangles no larger than MARIANI_SILVER_MIN_SIZE either way are computed pixel by pixel
+    return rectangle.x1 - rectangle.x0 + 1 <= MARIANI_SILVER_MIN_SIZE && rectangle.y1 - rectangle.y0 + 1 <= MARIANI_SILVER_MIN_SIZE;
+}
+
+static int mariani_silver_guard_sample(Rectangle rectangle, int sample, int *x, int *y) {
+
+    // Rectangles without interior pixels have nothing to check
+    if (rectangle.x1 - rectangle.x0 < 2 || rectangle.y1 - rectangle.y0 < 2) {
+        return 0;
+    }
+
+    // Interior pixel picked by hashing the rectangle, so the same pixel is found when queuing and checking
+    unsigned int hash = (unsigned int)rectangle.x0 * 73856093u ^ (unsigned int)rectangle.y0 * 19349663u
+                      ^ (unsigned int)rectangle.x1 * 83492791u ^ (unsigned int)rectangle.y1 * 2654435761u
+                      ^ (unsigned int)(sample + 1) * 3266489917u;
+    hash ^= hash >> 15;
+    hash *= 2246822519u;
+    hash ^= hash >> 13;
+    *x = rectangle.x0 + 1 + (int)(hash % (unsigned int)(rectangle.x1 - rectangle.x0 - 1));
+    *y = rectangle.y0 + 1 + (int)((hash >> 16) % (unsigned int)(rectangle.y1 - rectangle.y0 - 1));
+    return 1;
+}
+
+static void mariani_silver_queue(int width, int *result, int x, int y, int **pixels, int *pixel_count, int *pixel_capacity) {
+
+    // Skip pixels already computed or queued, e.g. on a border shared by two rectangles
+    int pixel = y * width + x;
+    if (result[pixel] != -1) {
+        return;
+    }
+    result[pixel] = -2;
+
+    if (*pixel_count == *pixel_capacity) {
+        *pixel_capacity *= 2;
+        *pixels = realloc(*pixels, sizeof(int) * *pixel_capacity);
+        if (!*pixels) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    (*pixels)[(*pixel_count)++] = pixel;
+}
+
+static Fixed fixed_from_double(double value) {
+
+    // Peel off 32 bits at a time; every step is exact for a double
+    Fixed result = {.negative = value < 0.0};
+    value = fabs(value);
+    for (int i = 0; i < DEEP_ZOOM_LIMBS; i++) {
+        double limb = floor(value);
+        result.limb[i] = (uint32_t)limb;
+        value = (value - limb) * 4294967296.0;
+    }
+    return result;
+}
+
+static Fixed fixed_from_string(const char *text) {
+
+    Fixed result = {.negative = 0};
+
+    if (*text == '-' || *text == '+') {
+        result.negative = *text == '-';
+        text++;
+    }
+
+    // Integer part
+    while (*text >= '0' && *text <= '9') {
+        result.limb[0] = result.limb[0] * 10 + (uint32_t)(*text - '0');
+        text++;
+    }
+
+    // Fractional digits, added from the last one: f = (digit + f) / 10
+    if (*text == '.') {
+        const char *first = ++text;
+        while (*text >= '0' && *text <= '9') {
+            text++;
+        }
+
+        Fixed fraction = {.negative = 0};
+        for (const char *digit = text - 1; digit >= first; digit--) {
+            fraction.limb[0] += (uint32_t)(*digit - '0');
+            uint64_t remainder = 0;
+            for (int i = 0; i < DEEP_ZOOM_LIMBS; i++) {
+                uint64_t current = (remainder << 32) | fraction.limb[i];
+                fraction.limb[i] = (uint32_t)(current / 10);
+                remainder = current % 10;
+            }
+        }
+        for (int i = 1; i < DEEP_ZOOM_LIMBS; i++) {
+            result.limb[i] = fraction.limb[i];
+        }
+    }
+
+    return result;
+}
+
+static double fixed_to_double(Fixed value) {
+
+    // The first three limbs hold more bits than a double keeps
+    double result = value.limb[0] + value.limb[1] / 4294967296.0 + value.limb[2] / 18446744073709551616.0;
+    return value.negative ? -result : result;
+}
+
+static Fixed fixed_add(Fixed a, Fixed b) {
+
+    Fixed result = {.negative = a.negative};
+
+    if (a.negative == b.negative) {
+        uint64_t carry = 0;
+        for (int i = DEEP_ZOOM_LIMBS - 1; i >= 0; i--) {
+            uint64_t sum = (uint64_t)a.limb[i] + b.limb[i] + carry;
+            result.limb[i] = (uint32_t)sum;
+            carry = sum >> 32;
+        }
+        return result;
+    }
+
+    // Opposite signs: subtract the smaller magnitude from the larger one
+    int a_larger = 1;
+    for (int i = 0; i < DEEP_ZOOM_LIMBS; i++) {
+        if (a.limb[i] != b.limb[i]) {
+            a_larger = a.limb[i] > b.limb[i];
+            break;
+        }
+    }
+    const Fixed *larger = a_larger ? &a : &b;
+    const Fixed *smaller = a_larger ? &b : &a;
+
+    result.negative = larger->negative;
+    int64_t borrow = 0;
+    for (int i = DEEP_ZOOM_LIMBS - 1; i >= 0; i--) {
+        int64_t difference = (int64_t)larger->limb[i] - smaller->limb[i] - borrow;
+        borrow = difference < 0;
+        result.limb[i] = (uint32_t)(difference + (borrow << 32));
+    }
+    return result;
+}
+
+static Fixed fixed_sub(Fixed a, Fixed b) {
+    b.negative = !b.negative;
+    return fixed_add(a, b);
+}
+
+static Fixed fixed_mul(Fixed a, Fixed b) {
+
+    // Schoolbook product; column k + 1 collects the products of limbs i + j = k.
+    // Each 64-bit product is split into 32-bit halves so the columns cannot overflow
+    uint64_t column[2 * DEEP_ZOOM_LIMBS + 1] = {0};
+    for (int i = 0; i < DEEP_ZOOM_LIMBS; i++) {
+        for (int j = 0; j < DEEP_ZOOM_LIMBS; j++) {
+            uint64_t product = (uint64_t)a.limb[i] * b.limb[j];
+            column[i + j + 1] += product & 0xffffffffu;
+            column[i + j] += product >> 32;
+        }
+    }
+    for (int k = 2 * DEEP_ZOOM_LIMBS; k > 0; k--) {
+        column[k - 1] += column[k] >> 32;
+        column[k] &= 0xffffffffu;
+    }
+
+    // Keep the integer limb and DEEP_ZOOM_LIMBS - 1 fractional limbs (the rest is truncated)
+    Fixed result = {.negative = a.negative != b.negative};
+    for (int i = 0; i < DEEP_ZOOM_LIMBS; i++) {
+        result.limb[i] = (uint32_t)column[i + 1];
+    }
+    return result;
+}
+
+static Complex complex_add(Complex a, Complex b) {
+    return (Complex){.real = a.real + b.real, .imag = a.imag + b.imag};
+}
+
+static Complex complex_mul(Complex a, Complex b) {
+    return (Complex){.real = a.real * b.real - a.imag * b.imag, .imag = a.real * b.imag + a.imag * b.real};
+}
+
+static double complex_abs(Complex a) {
+    return sqrt(a.real * a.real + a.imag * a.imag);
+}
+
+static Complex series_delta(const Complex *coefficients, Complex offset) {
+
+    // A d + B d^2 + C d^3, evaluated as ((C d + B) d + A) d
+    Complex delta = complex_add(complex_mul(coefficients[2], offset), coefficients[1]);
+    delta = complex_add(complex_mul(delta, offset), coefficients[0]);
+    return complex_mul(delta, offset);
+}
+
+static void prepare_reference_orbit(int rank, ReferenceOrbit *reference) {
+
+    reference->real = malloc(sizeof(double) * (MAX_ITERATION + 1));
+    reference->imag = malloc(sizeof(double) * (MAX_ITERATION + 1));
+    if (!reference->real || !reference->imag) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // Only rank 0 iterates at full precision; every other rank receives the rounded orbit
+    if (rank == 0) {
+        compute_reference_orbit(fixed_from_string(DEEP_ZOOM_CENTER_REAL), fixed_from_string(DEEP_ZOOM_CENTER_IMAG), reference);
+        if (DEEP_ZOOM_SERIES_APPROXIMATION) {
+            double spacing = 2.0 * DEEP_ZOOM_RADIUS / HEIGHT;
+            compute_series_approximation(reference, spacing * WIDTH / 2.0, DEEP_ZOOM_RADIUS);
+        }
+    }
+
+    MPI_Bcast(&reference->length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(reference->real, reference->length + 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(reference->imag, reference->length + 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&reference->skip, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(reference->series, 6, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+}
+
+static int view_needs_double_double(void) {
+
+    // Pixel spacing relative to the largest coordinate in the view. Below DOUBLE_DOUBLE_SPACING
+    // neighbouring pixels are only a few thousand ulps apart, and the rounding of every
+    // iteration soon swamps the difference between them
+    double xstep = (VIEW_XMAX - VIEW_XMIN) / WIDTH;
+    double ystep = (VIEW_YMAX - VIEW_YMIN) / HEIGHT;
+    double magnitude = fmax(fmax(fabs(VIEW_XMIN), fabs(VIEW_XMAX)), fmax(fabs(VIEW_YMIN), fabs(VIEW_YMAX)));
+
+    return fmin(xstep, ystep) < DOUBLE_DOUBLE_SPACING * magnitude;
+}
+
+#ifdef DOUBLE_DOUBLE_KERNELS
+// Knuth's two-sum: sum + error == a + b exactly
+KERNEL_INLINE
+void two_sum_lanes(const DoubleLanes *a, const DoubleLanes *b, DoubleLanes *sum, DoubleLanes *error) {
+    DoubleLanes s = *a + *b;
+    DoubleLanes b_virtual = s - *a;
+    *error = (*a - (s - b_virtual)) + (*b - b_virtual);
+    *sum = s;
+}
+
+// Dekker's two-product: product + error == a * b exactly. Splits each factor into 26-bit
+// halves rather than using FMA, so every target rounds the same way
+KERNEL_INLINE
+void two_product_lanes(const DoubleLanes *a, const DoubleLanes *b, DoubleLanes *product, DoubleLanes *error) {
+    DoubleLanes split = *a * 134217729.0; // 2^27 + 1
+    DoubleLanes a_hi = split - (split - *a);
+    DoubleLanes a_lo = *a - a_hi;
+    split = *b * 134217729.0;
+    DoubleLanes b_hi = split - (split - *b);
+    DoubleLanes b_lo = *b - b_hi;
+    DoubleLanes p = *a * *b;
+    *error = ((a_hi * b_hi - p) + a_hi * b_lo + a_lo * b_hi) + a_lo * b_lo;
+    *product = p;
+}
+
+KERNEL_INLINE
+void double_double_add(DoubleDoubleLanes *sum, const DoubleDoubleLanes *a, const DoubleDoubleLanes *b) {
+    DoubleLanes s, e;
+    two_sum_lanes(&a->hi, &b->hi, &s, &e);
+    e += a->lo + b->lo;
+    sum->hi = s + e;
+    sum->lo = e - (sum->hi - s);
+}
+
+KERNEL_INLINE
+void double_double_mul(DoubleDoubleLanes *product, const DoubleDoubleLanes *a, const DoubleDoubleLanes *b) {
+    DoubleLanes p, e;
+    two_product_lanes(&a->hi, &b->hi, &p, &e);
+    e += a->hi * b->lo + a->lo * b->hi;
+    product->hi = p + e;
+    product->lo = e - (product->hi - p);
+}
+
+// minimum + index * (maximum - minimum) / steps in double-double, so neighbouring pixels
+// stay distinct however small the spacing is compared to minimum
+KERNEL_INLINE
+void double_double_coordinates(DoubleDoubleLanes *coordinate, double minimum, double maximum, int steps, const DoubleLanes *index) {
+    DoubleLanes span = (DoubleLanes){0} + (maximum - minimum);
+    DoubleLanes count = (DoubleLanes){0} + (double)steps;
+
+    // Spacing as step + step_error, with step_error the remainder of the division
+    DoubleLanes step = span / count, product, product_error;
+    two_product_lanes(&step, &count, &product, &product_error);
+    DoubleDoubleLanes spacing = {.hi = step, .lo = ((span - product) - product_error) / count};
+
+    DoubleDoubleLanes offset = {.hi = *index, .lo = (DoubleLanes){0}};
+    DoubleDoubleLanes origin = {.hi = (DoubleLanes){0} + minimum, .lo = (DoubleLanes){0}};
+    double_double_mul(&offset, &offset, &spacing);
+    double_double_add(coordinate, &origin, &offset);
+}
+
+KERNEL_INLINE
+int lanes_any(const LaneMask *mask) {
+    long long lanes[DOUBLE_DOUBLE_LANES], merged = 0;
+    memcpy(lanes, mask, sizeof(lanes));
+    for (int lane = 0; lane < DOUBLE_DOUBLE_LANES; lane++) {
+        merged |= lanes[lane];
+    }
+    return merged != 0;
+}
+
+// Takes the lanes of other where mask is set and keeps the rest
+KERNEL_INLINE
+void lanes_replace(DoubleLanes *lanes, const LaneMask *mask, const DoubleLanes *other) {
+    *lanes = (DoubleLanes)(((LaneMask)*other & *mask) | ((LaneMask)*lanes & ~*mask));
+}
+#endif
+
+static MPI_Win open_work_counter(void) {
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    // The next row or tile to hand out lives in a window on rank 0. A one-sided counter needs
+    // no master loop, so rank 0 computes work like every other rank
+    int *next;
+    MPI_Win counter;
+    MPI_Win_allocate(rank == 0 ? sizeof(int) : 0, sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD, &next, &counter);
+    if (rank == 0) {
+        MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, counter);
+        *next = 0;
+        MPI_Win_unlock(0, counter);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    return counter;
+}
+
+static int take_from_counter(MPI_Win counter, int amount) {
+
+    // Atomically add amount to the counter on rank 0 and return its old value
+    int old_value;
+    MPI_Fetch_and_op(&amount, &old_value, MPI_INT, 0, 0, MPI_SUM, counter);
+    MPI_Win_flush(0, counter);
+    return old_value;
+}
+
+static int *block_cyclic_chunk_rows(int rank, int size, int unique_rows, int *chunk_count) {
+
+    // Chunks rank, rank + size, rank + 2 * size... of ROW_CHUNK_SIZE rows each
+    int total_chunks = (unique_rows + ROW_CHUNK_SIZE - 1) / ROW_CHUNK_SIZE;
+    *chunk_count = rank < total_chunks ? (total_chunks - rank + size - 1) / size : 0;
+
+    int *chunk_rows = malloc(sizeof(int) * (*chunk_count > 0 ? *chunk_count : 1));
+    if (chunk_rows == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (int i = 0; i < *chunk_count; i++) {
+        chunk_rows[i] = (rank + i * size) * ROW_CHUNK_SIZE;
+    }
+
+    return chunk_rows;
+}
+
+static int row_chunk_length(int start_row, int unique_rows) {
+
+    // The last chunk is cut off at the last row
+    return start_row + ROW_CHUNK_SIZE < unique_rows ? ROW_CHUNK_SIZE : unique_rows - start_row;
+}
+
+static void place_row_chunks(int *image, int unique_rows, const int *rows, const int *chunk_rows, int chunk_count) {
+
+    // Chunks are stored back to back in the order they were taken, each tagged with its first row
+    for (int i = 0; i < chunk_count; i++) {
+        int chunk_length = row_chunk_length(chunk_rows[i], unique_rows);
+        memcpy(&image[chunk_rows[i] * WIDTH], rows, sizeof(int) * WIDTH * chunk_length);
+        rows += WIDTH * chunk_length;
+    }
+}
+
+static MPI_Datatype row_chunks_type(int unique_rows, const int *chunk_rows, int chunk_count) {
+
+    // One block of ints per chunk, at the chunk's place in the full image, so a single receive
+    // scatters a rank's back-to-back rows straight into the image
+    int *lengths = malloc(sizeof(int) * (chunk_count > 0 ? chunk_count : 1));
+    int *displacements = malloc(sizeof(int) * (chunk_count > 0 ? chunk_count : 1));
+    if (lengths == NULL || displacements == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (int i = 0; i < chunk_count; i++) {
+        lengths[i] = WIDTH * row_chunk_length(chunk_rows[i], unique_rows);
+        displacements[i] = WIDTH * chunk_rows[i];
+    }
+
+    MPI_Datatype type;
+    MPI_Type_indexed(chunk_count, lengths, displacements, MPI_INT, &type);
+    MPI_Type_commit(&type);
+
+    free(lengths);
+    free(displacements);
+    return type;
+}
+
+static int tile_total(int unique_rows) {
+    return ((WIDTH + TILE_WIDTH - 1) / TILE_WIDTH) * ((unique_rows + TILE_HEIGHT - 1) / TILE_HEIGHT);
+}
+
+static Tile image_tile(int index, int unique_rows) {
+
+    int tile_columns = (WIDTH + TILE_WIDTH - 1) / TILE_WIDTH;
+
+    // Edge tiles are cut off at the last column and row
+    Tile tile;
+    tile.x = (index % tile_columns) * TILE_WIDTH;
+    tile.y = (index / tile_columns) * TILE_HEIGHT;
+    tile.width = tile.x + TILE_WIDTH < WIDTH ? TILE_WIDTH : WIDTH - tile.x;
+    tile.height = tile.y + TILE_HEIGHT < unique_rows ? TILE_HEIGHT : unique_rows - tile.y;
+    return tile;
+}
+
+static int *assigned_tiles(int rank, int size, int unique_rows, int *tile_count) {
+
+    // Block-cyclic: tiles rank, rank + size, rank + 2 * size... Otherwise a run of consecutive tiles
+    int total_tiles = tile_total(unique_rows);
+    int first = (int)((long long)total_tiles * rank / size);
+    int last = (int)((long long)total_tiles * (rank + 1) / size);
+    if (ROW_SCHEDULE == 2) {
+        *tile_count = rank < total_tiles ? (total_tiles - rank + size - 1) / size : 0;
+    } else {
+        *tile_count = last - first;
+    }
+
+    int *tiles = malloc(sizeof(int) * (*tile_count > 0 ? *tile_count : 1));
+    if (tiles == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (int i = 0; i < *tile_count; i++) {
+        tiles[i] = ROW_SCHEDULE == 2 ? rank + i * size : first + i;
+    }
+
+    return tiles;
+}
+
+static void place_tiles(int *image, int unique_rows, const int *pixels, const int *tiles, int tile_count) {
+
+    // Tiles are stored back to back, each row by row, in the order of the list
+    for (int i = 0; i < tile_count; i++) {
+        Tile tile = image_tile(tiles[i], unique_rows);
+        for (int y = 0; y < tile.height; y++) {
+            memcpy(&image[(tile.y + y) * WIDTH + tile.x], pixels, sizeof(int) * tile.width);
+            pixels += tile.width;
+        }
+    }
+}
+
+static MPI_Datatype tiles_type(int unique_rows, const int *tiles, int tile_count) {
+
+    // One block of ints per tile row, at its place in the full image, so a single receive
+    // scatters a rank's back-to-back tiles straight into the image
+    int block_count = 0;
+    for (int i = 0; i < tile_count; i++) {
+        block_count += image_tile(tiles[i], unique_rows).height;
+    }
+
+    int *lengths = malloc(sizeof(int) * (block_count > 0 ? block_count : 1));
+    int *displacements = malloc(sizeof(int) * (block_count > 0 ? block_count : 1));
+    if (lengths == NULL || displacements == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    int block = 0;
+    for (int i = 0; i < tile_count; i++) {
+        Tile tile = image_tile(tiles[i], unique_rows);
+        for (int y = 0; y < tile.height; y++, block++) {
+            lengths[block] = tile.width;
+            displacements[block] = (tile.y + y) * WIDTH + tile.x;
+        }
+    }
+
+    MPI_Datatype type;
+    MPI_Type_indexed(block_count, lengths, displacements, MPI_INT, &type);
+    MPI_Type_commit(&type);
+
+    free(lengths);
+    free(displacements);
+    return type;
+}
+
+static void split_rows_by_cost(const double *row_costs, int unique_rows, int rank, int size, int *start_row, int *end_row) {
+
+    double total = 0.0;
+    for (int y = 0; y < unique_rows; y++) {
+        total += row_costs[y];
+    }
+
+    // Rank r starts at the first row where the running cost reaches r / size of the total.
+    // Every rank sums in the same order, so neighbouring blocks meet exactly
+    double cost = 0.0;
+    *start_row = *end_row = unique_rows;
+    for (int y = 0; y < unique_rows; y++) {
+        if (*start_row == unique_rows && cost >= total * rank / size) {
+            *start_row = y;
+        }
+        if (rank + 1 < size && cost >= total * (rank + 1) / size) {
+            *end_row = y;
+            break;
+        }
+        cost += row_costs[y];
+    }
+    if (*end_row < *start_row) {
+        *end_row = *start_row;
+    }
+}
+
+static void build_color_table(int png_output) {
+
+    // The four bytes of each entry hold the RGBA values in memory order,
+    // so a row of entries is a PNG row as it stands
+    for (int iteration = 0; iteration <= MAX_ITERATION; iteration++) {
+        int red, green, blue;
+        map_to_color(iteration, &red, &green, &blue, COLOR_CHOICE);
+        png_byte rgba[4] = {red, green, blue, 255};
+        memcpy(&color_table[iteration], rgba, sizeof(color_table[iteration]));
+    }
+    if (!PALETTE_OUTPUT || !png_output) {
+        return;
+    }
+
+    // Alpha is always 255, so at worst the pixels shrink to RGB
+    png_color_type = PNG_COLOR_TYPE_RGB;
+    png_pixel_bytes = 3;
+
+    // Collect the distinct colours in order of first use
+    png_palette_size = 0;
+    for (int iteration = 0; iteration <= MAX_ITERATION; iteration++) {
+        png_byte *rgba = (png_byte *)&color_table[iteration];
+        if (palette_index(rgba) == png_palette_size) {
+            if (png_palette_size == 256) {
+                png_palette_size = 0;
+                return;
+            }
+            png_palette[png_palette_size++] = (png_color){rgba[0], rgba[1], rgba[2]};
+        }
+    }
+
+    // Entries now hold the palette index in their first byte
+    png_color_type = PNG_COLOR_TYPE_PALETTE;
+    png_pixel_bytes = 1;
+    for (int iteration = 0; iteration <= MAX_ITERATION; iteration++) {
+        png_byte entry[4] = {palette_index((png_byte *)&color_table[iteration]), 0, 0, 0};
+        memcpy(&color_table[iteration], entry, sizeof(color_table[iteration]));
+    }
+}
+
+static int palette_index(const png_byte *rgba) {
+
+    // Index of the colour in png_palette, or png_palette_size when it is not there yet
+    int index = 0;
+    while (index < png_palette_size && (png_palette[index].red != rgba[0] || png_palette[index].green != rgba[1] || png_palette[index].blue != rgba[2])) {
+        index++;
+    }
+    return index;
+}
+
+static void pack_png_pixels(const png_byte *pixels, png_bytep row) {
+
+    // Keep the first png_pixel_bytes of each 4-byte pixel. Every byte moves to the same place or
+    // further forward, so pixels and row may be the same buffer
+    if (png_pixel_bytes == 4) {
+        memmove(row, pixels, 4 * WIDTH);
+    } else if (png_pixel_bytes == 3) {
+        for (int x = 0; x < WIDTH; x++) {
+            row[3 * x] = pixels[4 * x];
+            row[3 * x + 1] = pixels[4 * x + 1];
+            row[3 * x + 2] = pixels[4 * x + 2];
+        }
+    } else {
+        for (int x = 0; x < WIDTH; x++) {
+            row[x] = pixels[4 * x];
+        }
+    }
+}
+
+static int pixel_color(int iteration) {
+    return color_table[iteration];
+}
+
+static void color_pixels(const int *iterations, int *pixels, int pixel_count) {
+    color_kernel(iterations, pixels, pixel_count);
+}
+
+static void color_pixels_scalar(const int *iterations, int *pixels, int pixel_count) {
+    for (int i = 0; i < pixel_count; i++) {
+        pixels[i] = color_table[iterations[i]];
+    }
+}
+
+#ifdef X86_KERNELS
+__attribute__((target("avx2")))
+static void color_pixels_avx2(const int *iterations, int *pixels, int pixel_count) {
+    int i = 0;
+    for (; i + 8 <= pixel_count; i += 8) {
+        __m256i index = _mm256_loadu_si256((const __m256i *)&iterations[i]);
+        _mm256_storeu_si256((__m256i *)&pixels[i], _mm256_i32gather_epi32(color_table, index, 4));
+    }
+    color_pixels_scalar(&iterations[i], &pixels[i], pixel_count - i);
+}
+
+__attribute__((target("avx512f")))
+static void color_pixels_avx512(const int *iterations, int *pixels, int pixel_count) {
+    int i = 0;
+    for (; i + 16 <= pixel_count; i += 16) {
+        __m512i index = _mm512_loadu_si512(&iterations[i]);
+        _mm512_storeu_si512(&pixels[i], _mm512_i32gather_epi32(index, color_table, 4));
+    }
+    color_pixels_scalar(&iterations[i], &pixels[i], pixel_count - i);
+}
+#endif
+
+static int write_dzi_pyramid(const char *filename, unsigned char *strip, int start_row, int end_row, int rank, int size) {
+
+    double start_time = MPI_Wtime();
+
+    // The pyramid is named after the image without its extension
+    char name[100], directory[120], path[200];
+    snprintf(name, sizeof(name), "%s", filename);
+    *strrchr(name, '.') = '\0';
+    snprintf(directory, sizeof(directory), "%s_files", name);
+
+    // The top level is the image itself, and each level below halves the one above, rounding up,
+    // down to a single pixel at level 0
+    int top_level = 0;
+    while ((WIDTH > HEIGHT ? WIDTH : HEIGHT) > 1 << top_level) {
+        top_level++;
+    }
+    dzi_levels = top_level + 1;
+
+    // Rank 0 writes the descriptor and makes a directory per level before any rank writes a tile
+    int error = 0;
+    if (rank == 0) {
+        snprintf(path, sizeof(path), "%s.dzi", name);
+        FILE *fp = fopen(path, "w");
+        error = !fp;
+        if (fp) {
+            error |= fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                                 "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"%s\" Overlap=\"%d\" TileSize=\"%d\">\n"
+                                 "  <Size Width=\"%d\" Height=\"%d\"/>\n"
+                                 "</Image>\n", image_extensions[IMAGE_ENCODER], DZI_OVERLAP, DZI_TILE_SIZE, WIDTH, HEIGHT) < 0;
+            error |= fclose(fp) != 0;
+        }
+        error |= mkdir(directory, 0755) != 0 && errno != EEXIST;
+        for (int level = 0; level <= top_level; level++) {
+            snprintf(path, sizeof(path), "%s/%d", directory, level);
+            error |= mkdir(path, 0755) != 0 && errno != EEXIST;
+        }
+        if (error) {
+            fprintf(stderr, "Error creating %s.dzi and its directories\n", name);
+        }
+    }
+    MPI_Bcast(&error, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (error) {
+        return 1;
+    }
+
+    // Each rank holds the rows [first, last) of the level, starting with its own strip of pixels
+    unsigned char *rows = strip;
+    int first = start_row, last = end_row;
+    int width = WIDTH, height = HEIGHT;
+    for (int level = top_level; level >= 0; level--) {
+
+        // A rank writes the tile rows that start in its rows, and the rows of the next level that
+        // are made from them. For that it needs the overlap around its tile rows and the row pairs
+        // that get averaged, some of which lie on the neighbouring ranks
+        int start_tile_row = (first + DZI_TILE_SIZE - 1) / DZI_TILE_SIZE;
+        int end_tile_row = (last + DZI_TILE_SIZE - 1) / DZI_TILE_SIZE;
+        int next_width = (width + 1) / 2, next_height = (height + 1) / 2;
+        int next_first = (start_tile_row * DZI_TILE_SIZE + 1) / 2, next_last = (end_tile_row * DZI_TILE_SIZE + 1) / 2;
+        next_first = next_first < next_height ? next_first : next_height;
+        next_last = next_last < next_height ? next_last : next_height;
+
+        int range[4] = {first, last, 0, 0};
+        if (start_tile_row < end_tile_row) {
+            range[2] = start_tile_row * DZI_TILE_SIZE - DZI_OVERLAP;
+            range[3] = end_tile_row * DZI_TILE_SIZE + DZI_OVERLAP;
+            if (level > 0) {
+                range[2] = range[2] < 2 * next_first ? range[2] : 2 * next_first;
+                range[3] = range[3] > 2 * next_last ? range[3] : 2 * next_last;
+            }
+            range[2] = range[2] > 0 ? range[2] : 0;
+            range[3] = range[3] < height ? range[3] : height;
+        }
+
+        // Every rank learns which rows the others hold and need, and the missing rows are exchanged
+        int *ranges = malloc(sizeof(int) * 4 * size);
+        if (!ranges) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        MPI_Allgather(range, 4, MPI_INT, ranges, 4, MPI_INT, MPI_COMM_WORLD);
+        unsigned char *needed_rows = exchange_level_rows(rows, width, ranges, rank, size);
+        free(ranges);
+        if (rows != strip) {
+            free(rows);
+        }
+
+        error |= write_dzi_tiles(directory, level, needed_rows, width, height, range[2], start_tile_row, end_tile_row);
+
+        // The next level keeps the same split, halved
+        rows = NULL;
+        if (level > 0) {
+            rows = malloc((size_t)(next_last - next_first) * next_width * 4 + 1);
+            if (!rows) {
+                fprintf(stderr, "Error: Memory allocation failed\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            downsample_level_rows(needed_rows, width, height, range[2], next_first, next_last, rows);
+        }
+        free(needed_rows);
+        first = next_first;
+        last = next_last;
+        width = next_width;
+        height = next_height;
+    }
+
+    dzi_time = MPI_Wtime() - start_time;
+    return error;
+}
+
+static unsigned char *exchange_level_rows(const unsigned char *rows, int width, const int *ranges, int rank, int size) {
+
+    // ranges holds four numbers per rank: the rows [ranges[0], ranges[1]) it holds and the rows
+    // [ranges[2], ranges[3]) it needs. Each rank sends every other rank the rows they have in common
+    int *counts = malloc(sizeof(int) * 4 * size);
+    if (!counts) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    int *send_counts = counts, *send_offsets = &counts[size], *receive_counts = &counts[2 * size], *receive_offsets = &counts[3 * size];
+    const int *own = &ranges[4 * rank];
+    for (int i = 0; i < size; i++) {
+        const int *other = &ranges[4 * i];
+
+        int start = own[0] > other[2] ? own[0] : other[2];
+        int end = own[1] < other[3] ? own[1] : other[3];
+        send_counts[i] = end > start ? end - start : 0;
+        send_offsets[i] = end > start ? start - own[0] : 0;
+
+        start = other[0] > own[2] ? other[0] : own[2];
+        end = other[1] < own[3] ? other[1] : own[3];
+        receive_counts[i] = end > start ? end - start : 0;
+        receive_offsets[i] = end > start ? start - own[2] : 0;
+    }
+
+    unsigned char *needed_rows = malloc((size_t)(own[3] - own[2]) * width * 4 + 1);
+    if (!needed_rows) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // Counted in rows, so the counts stay small however wide the image
+    MPI_Datatype row_type;
+    MPI_Type_contiguous(width * 4, MPI_BYTE, &row_type);
+    MPI_Type_commit(&row_type);
+    MPI_Alltoallv(rows, send_counts, send_offsets, row_type, needed_rows, receive_counts, receive_offsets, row_type, MPI_COMM_WORLD);
+    MPI_Type_free(&row_type);
+    free(counts);
+    return needed_rows;
+}
+
+static int write_dzi_tiles(const char *directory, int level, const unsigned char *rows, int width, int height, int first_row, int start_tile_row, int end_tile_row) {
+
+    // Tile (column, row) covers its DZI_TILE_SIZE square plus the overlap on every side that has a neighbour
+    char path[200];
+    int error = 0;
+    for (int tile_row = start_tile_row; tile_row < end_tile_row; tile_row++) {
+        int y0 = tile_row * DZI_TILE_SIZE - DZI_OVERLAP > 0 ? tile_row * DZI_TILE_SIZE - DZI_OVERLAP : 0;
+        int y1 = (tile_row + 1) * DZI_TILE_SIZE + DZI_OVERLAP < height ? (tile_row + 1) * DZI_TILE_SIZE + DZI_OVERLAP : height;
+        for (int column = 0; column * DZI_TILE_SIZE < width; column++) {
+            int x0 = column * DZI_TILE_SIZE - DZI_OVERLAP > 0 ? column * DZI_TILE_SIZE - DZI_OVERLAP : 0;
+            int x1 = (column + 1) * DZI_TILE_SIZE + DZI_OVERLAP < width ? (column + 1) * DZI_TILE_SIZE + DZI_OVERLAP : width;
+
+            snprintf(path, sizeof(path), "%s/%d/%d_%d.%s", directory, level, column, tile_row, image_extensions[IMAGE_ENCODER]);
+            ImageEncoder encoder;
+            if (open_image_encoder(&encoder, path, x1 - x0, y1 - y0)) {
+                return 1;
+            }
+            for (int y = y0; y < y1; y++) {
+                if (encode_image_row(&encoder, &rows[((size_t)(y - first_row) * width + x0) * 4])) {
+                    close_image_encoder(&encoder);
+                    return 1;
+                }
+            }
+            error |= close_image_encoder(&encoder);
+            dzi_tiles++;
+        }
+    }
+    return error;
+}
+
+static void downsample_level_rows(const unsigned char *rows, int width, int height, int first_row, int start, int end, unsigned char *next_rows) {
+
+    // Each pixel of the next level is the rounded mean of a 2x2 block. Along an odd edge the block is
+    // cut in half, and the pixels on the edge are counted twice
+    int next_width = (width + 1) / 2;
+    for (int y = start; y < end; y++) {
+        const unsigned char *top = &rows[(size_t)(2 * y - first_row) * width * 4];
+        const unsigned char *bottom = 2 * y + 1 < height ? top + (size_t)width * 4 : top;
+        unsigned char *out = &next_rows[(size_t)(y - start) * next_width * 4];
+        for (int x = 0; x < next_width; x++) {
+            int left = 8 * x, right = 2 * x + 1 < width ? left + 4 : left;
+            for (int channel = 0; channel < 4; channel++) {
+                out[4 * x + channel] = (top[left + channel] + top[right + channel] + bottom[left + channel] + bottom[right + channel] + 2) >> 2;
+            }
+        }
+    }
+}
+
+static void write_image_rows(ImageEncoder *encoder, const int *array, int rows, png_bytep row_data, unsigned long long *current_pixel) {
+
+    // Rows the ranks coloured themselves go to the encoder as they are, or packed to RGB or palette indices
+    if (WORKER_COLOR) {
+        for (int y = 0; y < rows; y++) {
+            if (png_pixel_bytes == 4) {
+                if (encode_image_row(encoder, (png_const_bytep)&array[y * WIDTH])) {
+                    MPI_Abort(MPI_COMM_WORLD, 1);
+                }
+            } else {
+                pack_png_pixels((const png_byte *)&array[y * WIDTH], row_data);
+                if (encode_image_row(encoder, row_data)) {
+                    MPI_Abort(MPI_COMM_WORLD, 1);
+                }
+            }
+            *current_pixel += WIDTH;
+            printf("\rPNG Pixel Progress: %.2f%% Pixel Count: %llu", (double)*current_pixel / ((double)WIDTH * HEIGHT) * 100, *current_pixel);
+        }
+        return;
+    }
+
+    for (int y = 0; y < rows; y++) {
+
+        // Look the whole row up in the colour table
+        color_pixels(&array[y * WIDTH], (int *)row_data, WIDTH);
+        pack_png_pixels(row_data, row_data);
+        *current_pixel += WIDTH;
+        printf("\rPNG Pixel Progress: %.2f%% Pixel Count: %llu", (double)*current_pixel / ((double)WIDTH * HEIGHT) * 100, *current_pixel);
+
+        // Write current row to the image
+        if (encode_image_row(encoder, &row_data[0])) {
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+}
+
+static void send_streamed_rows(const int *array, int rows) {
+
+    // Every message waits for its credit, so it always meets a posted receive on rank 0 and never
+    // piles up there as an unexpected message
+    for (int row = 0; row < rows; row += STREAM_ROWS) {
+        int message_rows = rows - row < STREAM_ROWS ? rows - row : STREAM_ROWS;
+        MPI_Recv(NULL, 0, MPI_INT, 0, 8, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Send(&array[row * WIDTH], message_rows * WIDTH, MPI_INT, 0, 9, MPI_COMM_WORLD);
+    }
+}
+
+static void write_streamed_strips(ImageEncoder *encoder, int size, const int *rows, int row_count, const int *mirror_rows, int mirror_row_count,
+                           png_bytep row_data, unsigned long long *current_pixel) {
+
+    // Strip sizes of every rank: size_requests[i] receives rank i's strip, size_requests[size + i]
+    // its mirrored rows
+    int *strip_sizes = calloc(2 * size, sizeof(int));
+    MPI_Request *size_requests = malloc(sizeof(MPI_Request) * 2 * size);
+    int *buffers = malloc(sizeof(int) * STREAM_CREDITS * STREAM_ROWS * WIDTH);
+    if (strip_sizes == NULL || size_requests == NULL || buffers == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (int i = 0; i < 2 * size; i++) {
+        size_requests[i] = MPI_REQUEST_NULL;
+        if (i % size > 0) {
+            MPI_Irecv(&strip_sizes[i], 1, MPI_INT, i % size, i < size ? 0 : 2, MPI_COMM_WORLD, &size_requests[i]);
+        }
+    }
+
+    // The buffers form a ring of messages in write order: the oldest at first_buffer, the others
+    // behind it with their receives posted and their credits granted
+    MPI_Request buffer_requests[STREAM_CREDITS];
+    int buffer_rows[STREAM_CREDITS];
+    int first_buffer = 0, buffers_in_use = 0;
+
+    // Strips in write order: the computed rows of ranks 1 .. size - 1, then the mirrored rows of
+    // ranks size - 1 .. 1. Credits are granted up to STREAM_CREDITS messages ahead of the writing
+    int strip = 0, strip_row = 0;
+    int strip_count = 2 * (size - 1);
+    int own_rows_written = 0;
+    while (1) {
+
+        while (buffers_in_use < STREAM_CREDITS && strip < strip_count) {
+
+            // Move on to the next strip once its size is known. Only wait for the size when there
+            // is nothing to write in the meantime
+            int source = strip < size - 1 ? strip + 1 : 2 * size - 2 - strip;
+            int size_index = strip < size - 1 ? source : size + source;
+            int known;
+            MPI_Test(&size_requests[size_index], &known, MPI_STATUS_IGNORE);
+            if (!known && (buffers_in_use > 0 || !own_rows_written)) {
+                break;
+            }
+            if (!known) {
+                MPI_Wait(&size_requests[size_index], MPI_STATUS_IGNORE);
+            }
+
+            int rows = strip_sizes[size_index] / WIDTH;
+            if (strip_row >= rows) {
+                strip++;
+                strip_row = 0;
+                continue;
+            }
+
+            int buffer = (first_buffer + buffers_in_use) % STREAM_CREDITS;
+            buffer_rows[buffer] = rows - strip_row < STREAM_ROWS ? rows - strip_row : STREAM_ROWS;
+            MPI_Irecv(&buffers[buffer * STREAM_ROWS * WIDTH], buffer_rows[buffer] * WIDTH, MPI_INT, source, 9, MPI_COMM_WORLD, &buffer_requests[buffer]);
+            MPI_Send(NULL, 0, MPI_INT, source, 8, MPI_COMM_WORLD);
+            buffers_in_use++;
+            strip_row += buffer_rows[buffer];
+        }
+
+        // Rank 0's own rows come first, while the first messages are on their way
+        if (!own_rows_written) {
+            write_image_rows(encoder, rows, row_count, row_data, current_pixel);
+            own_rows_written = 1;
+        }
+
+        // With nothing in flight, either every strip is written or the next size has to be waited for
+        if (buffers_in_use == 0 && strip == strip_count) {
+            break;
+        }
+        if (buffers_in_use == 0) {
+            continue;
+        }
+
+        // Write the oldest message and hand its buffer to the next one
+        MPI_Wait(&buffer_requests[first_buffer], MPI_STATUS_IGNORE);
+        write_image_rows(encoder, &buffers[first_buffer * STREAM_ROWS * WIDTH], buffer_rows[first_buffer], row_data, current_pixel);
+        first_buffer = (first_buffer + 1) % STREAM_CREDITS;
+        buffers_in_use--;
+    }
+
+    // Rank 0's mirrored rows are the last rows of the image
+    write_image_rows(encoder, mirror_rows, mirror_row_count, row_data, current_pixel);
+
+    free(strip_sizes);
+    free(size_requests);
+    free(buffers);
+}
+
+static int chunk_mirror_rows(int start_row, int unique_rows, int *mirror_start) {
+
+    // Rows HEIGHT - end_row + 1 .. HEIGHT - start_row mirror the chunk, as for a strip (row 0 has no mirror)
+    int end_row = start_row + row_chunk_length(start_row, unique_rows);
+    int mirror_end = HEIGHT - start_row + 1 < HEIGHT ? HEIGHT - start_row + 1 : HEIGHT;
+    *mirror_start = HEIGHT - end_row + 1 > unique_rows ? HEIGHT - end_row + 1 : unique_rows;
+    return mirror_end > *mirror_start ? mirror_end - *mirror_start : 0;
+}
+
+static void send_streamed_chunks(const int *rows, const int *chunk_rows, int chunk_count, const int *mirror_rows, int unique_rows) {
+
+    // Each chunk goes in messages of its own, so no message holds rows of two chunks. The mirrored
+    // rows follow, last chunk first, in the order the file has them
+    int row = 0;
+    for (int i = 0; i < chunk_count; i++) {
+        int length = row_chunk_length(chunk_rows[i], unique_rows);
+        send_streamed_rows(&rows[row * WIDTH], length);
+        row += length;
+    }
+    if (mirror_rows) {
+        row = 0;
+        for (int i = chunk_count - 1; i >= 0; i--) {
+            int mirror_start;
+            int length = chunk_mirror_rows(chunk_rows[i], unique_rows, &mirror_start);
+            send_streamed_rows(&mirror_rows[row * WIDTH], length);
+            row += length;
+        }
+    }
+}
+
+static void write_streamed_chunks(ImageEncoder *encoder, int size, int unique_rows, int symmetric, const int *rows, const int *chunk_rows,
+                                  int chunk_count, const int *mirror_rows, png_bytep row_data, unsigned long long *current_pixel) {
+
+    // Segments in write order: every chunk, then with symmetry the mirrored rows of every chunk, last
+    // chunk first. Rank 0's own segments point into its rows, the others come from their owner
+    int total_chunks = (unique_rows + ROW_CHUNK_SIZE - 1) / ROW_CHUNK_SIZE;
+    int segment_count = symmetric ? 2 * total_chunks : total_chunks;
+    int *segment_rows = malloc(sizeof(int) * (segment_count > 0 ? segment_count : 1));
+    int *segment_owners = malloc(sizeof(int) * (segment_count > 0 ? segment_count : 1));
+    const int **own_segments = calloc(segment_count > 0 ? segment_count : 1, sizeof(int *));
+    int *buffers = malloc(sizeof(int) * STREAM_CREDITS * STREAM_ROWS * WIDTH);
+    if (segment_rows == NULL || segment_owners == NULL || own_segments == NULL || buffers == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (int chunk = 0; chunk < total_chunks; chunk++) {
+        int mirror_start;
+        segment_rows[chunk] = row_chunk_length(chunk * ROW_CHUNK_SIZE, unique_rows);
+        if (symmetric) {
+            segment_rows[segment_count - 1 - chunk] = chunk_mirror_rows(chunk * ROW_CHUNK_SIZE, unique_rows, &mirror_start);
+        }
+    }
+
+    // The dynamic schedule sends its chunk lists, the block-cyclic owners are known
+    for (int i = 0; i < size; i++) {
+        int *received_list = NULL;
+        int count = chunk_count;
+        if (i > 0 && ROW_SCHEDULE == 1) {
+            MPI_Recv(&count, 1, MPI_INT, i, 4, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            received_list = malloc(sizeof(int) * (count > 0 ? count : 1));
+            if (received_list == NULL) {
+                fprintf(stderr, "Error: Memory allocation failed\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            MPI_Recv(received_list, count, MPI_INT, i, 5, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        } else if (i > 0) {
+            received_list = block_cyclic_chunk_rows(i, size, unique_rows, &count);
+        }
+        const int *list = i > 0 ? received_list : chunk_rows;
+        for (int j = 0; j < count; j++) {
+            int chunk = list[j] / ROW_CHUNK_SIZE;
+            segment_owners[chunk] = i;
+            if (symmetric) {
+                segment_owners[segment_count - 1 - chunk] = i;
+            }
+        }
+        free(received_list);
+    }
+    int row = 0, mirror_row = 0;
+    for (int i = 0; i < chunk_count; i++) {
+        int chunk = chunk_rows[i] / ROW_CHUNK_SIZE;
+        own_segments[chunk] = &rows[row * WIDTH];
+        row += segment_rows[chunk];
+    }
+    if (symmetric) {
+        for (int i = chunk_count - 1; i >= 0; i--) {
+            int segment = segment_count - 1 - chunk_rows[i] / ROW_CHUNK_SIZE;
+            own_segments[segment] = &mirror_rows[mirror_row * WIDTH];
+            mirror_row += segment_rows[segment];
+        }
+    }
+
+    // The buffers form a ring of messages in write order: the oldest at first_buffer, the others
+    // behind it with their receives posted and their credits granted
+    MPI_Request buffer_requests[STREAM_CREDITS];
+    int buffer_rows[STREAM_CREDITS];
+    int first_buffer = 0, buffers_in_use = 0;
+
+    // Credits are granted up to STREAM_CREDITS messages ahead of the writing, across segments
+    int credit_segment = 0, credit_row = 0;
+    int segment = 0, segment_row = 0;
+    while (segment < segment_count) {
+
+        while (buffers_in_use < STREAM_CREDITS && credit_segment < segment_count) {
+            if (own_segments[credit_segment] || credit_row >= segment_rows[credit_segment]) {
+                credit_segment++;
+                credit_row = 0;
+                continue;
+            }
+            int source = segment_owners[credit_segment];
+            int buffer = (first_buffer + buffers_in_use) % STREAM_CREDITS;
+            buffer_rows[buffer] = segment_rows[credit_segment] - credit_row < STREAM_ROWS ? segment_rows[credit_segment] - credit_row : STREAM_ROWS;
+            MPI_Irecv(&buffers[buffer * STREAM_ROWS * WIDTH], buffer_rows[buffer] * WIDTH, MPI_INT, source, 9, MPI_COMM_WORLD, &buffer_requests[buffer]);
+            MPI_Send(NULL, 0, MPI_INT, source, 8, MPI_COMM_WORLD);
+            buffers_in_use++;
+            credit_row += buffer_rows[buffer];
+        }
+
+        // Rank 0 writes its own segments at once, while the messages of the next ones are on their way
+        if (own_segments[segment]) {
+            write_image_rows(encoder, own_segments[segment], segment_rows[segment], row_data, current_pixel);
+            segment++;
+            continue;
+        }
+        if (segment_row >= segment_rows[segment]) {
+            segment++;
+            segment_row = 0;
+            continue;
+        }
+
+        // Write the oldest message and hand its buffer to the next one
+        MPI_Wait(&buffer_requests[first_buffer], MPI_STATUS_IGNORE);
+        write_image_rows(encoder, &buffers[first_buffer * STREAM_ROWS * WIDTH], buffer_rows[first_buffer], row_data, current_pixel);
+        segment_row += buffer_rows[first_buffer];
+        first_buffer = (first_buffer + 1) % STREAM_CREDITS;
+        buffers_in_use--;
+    }
+
+    free(segment_rows);
+    free(segment_owners);
+    free(own_segments);
+    free(buffers);
+}
+
+static inline __attribute__((always_inline))
+png_byte filtered_png_byte(int filter, int value, int left, int above, int above_left) {
+
+    // Filter a byte given its neighbours in the same channel: left, above and above left
+    switch (filter) {
+        case 1: // Sub
+            return value - left;
+        case 2: // Up
+            return value - above;
+        case 3: // Average
+            return value - (left + above) / 2;
+        case 4: { // Paeth: whichever neighbour is closest to left + above - above_left
+            int estimate = left + above - above_left;
+            int to_left = abs(estimate - left), to_above = abs(estimate - above), to_above_left = abs(estimate - above_left);
+            int nearest = to_above <= to_above_left ? above : above_left;
+            return value - (to_left <= to_above && to_left <= to_above_left ? left : nearest);
+        }
+        default: // None
+            return value;
+    }
+}
+
+static void filter_png_row(const png_byte *row, const png_byte *previous, int filters, png_byte *filtered) {
+
+    // Pick, among the filters set in filters as 1 << filter, the one with the smallest sum of filtered
+    // bytes taken as signed, as libpng does, scoring all five in one pass over the row. When only one
+    // filter is allowed there is nothing to score
+    int pixel_bytes = png_pixel_bytes;
+    int row_bytes = pixel_bytes * WIDTH;
+    long sums[5] = {0};
+    for (int i = 0; (filters & (filters - 1)) != 0 && i < row_bytes; i++) {
+        int left = i >= pixel_bytes ? row[i - pixel_bytes] : 0;
+        int above_left = i >= pixel_bytes ? previous[i - pixel_bytes] : 0;
+        // (spelled out so each call inlines to a single filter)
+        png_byte values[5] = {
+            filtered_png_byte(0, row[i], left, previous[i], above_left),
+            filtered_png_byte(1, row[i], left, previous[i], above_left),
+            filtered_png_byte(2, row[i], left, previous[i], above_left),
+            filtered_png_byte(3, row[i], left, previous[i], above_left),
+            filtered_png_byte(4, row[i], left, previous[i], above_left)
+        };
+        for (int filter = 0; filter < 5; filter++) {
+            sums[filter] += values[filter] < 128 ? values[filter] : 256 - values[filter];
+        }
+    }
+
+    int best_filter = -1;
+    for (int filter = 0; filter < 5; filter++) {
+        if ((filters & 1 << filter) && (best_filter < 0 || sums[filter] < sums[best_filter])) {
+            best_filter = filter;
+        }
+    }
+
+    filtered[0] = best_filter;
+    for (int i = 0; i < row_bytes; i++) {
+        int left = i >= pixel_bytes ? row[i - pixel_bytes] : 0;
+        int above_left = i >= pixel_bytes ? previous[i - pixel_bytes] : 0;
+        filtered[i + 1] = filtered_png_byte(best_filter, row[i], left, previous[i], above_left);
+    }
+}
+
+static unsigned char *deflate_png_rows(const int *array, int rows, int *length, unsigned long *adler) {
+
+    int row_bytes = png_pixel_bytes * WIDTH;
+    *adler = adler32(0L, Z_NULL, 0);
+    *length = 0;
+    if (rows == 0) {
+        return NULL;
+    }
+    double start_time = MPI_Wtime();
+
+    // Raw deflate without zlib header or trailer, as rank 0 writes those once for the whole stream
+    z_stream stream = {0};
+    int level, strategy, filters;
+    png_encoder_settings(&level, &strategy, &filters);
+    if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, strategy == -1 ? Z_FILTERED : strategy) != Z_OK) {
+        fprintf(stderr, "Error: deflateInit2 failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // The bound covers Z_FINISH, and a sync flush adds at most a few bytes more
+    // Filters the rows may use as 1 << filter (PNG_FILTER_NONE is 1 << 3): those of PNG_ROW_FILTERS or the
+    // fast preset, or else all five, and only None for palette rows as libpng does. The first row of a
+    // segment follows a row that belongs to another rank, so only None and Sub are possible there, since
+    // Up, Average and Paeth read the row above (previous is then a row of zeros). None is the fallback
+    int row_filters = filters != -1 ? (filters >> 3) & 31 : png_color_type == PNG_COLOR_TYPE_PALETTE ? 1 : 31;
+    int first_row_filters = row_filters & 3 ? row_filters & 3 : 1;
+    row_filters = row_filters ? row_filters : 1;
+
+    uLong capacity = deflateBound(&stream, (uLong)rows * (row_bytes + 1)) + 64;
+    unsigned char *segment = malloc(capacity);
+    png_bytep pixels = calloc(2, 4 * WIDTH);
+    png_bytep filtered = malloc(row_bytes + 1);
+    if (segment == NULL || pixels == NULL || filtered == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    stream.next_out = segment;
+    stream.avail_out = capacity;
+
+    for (int y = 0; y < rows; y++) {
+
+        // Rows alternate between the two halves of the pixel buffer, so the previous row is at hand
+        // (the zeroed second half stands in for the row above the first)
+        png_bytep row = &pixels[(y % 2) * 4 * WIDTH];
+        png_bytep previous = &pixels[((y + 1) % 2) * 4 * WIDTH];
+        // (each half holds a row of 4-byte pixels before they are packed, so the packed rows
+        // are 4 * WIDTH bytes apart)
+        if (WORKER_COLOR) {
+            pack_png_pixels((const png_byte *)&array[y * WIDTH], row);
+        } else {
+            color_pixels(&array[y * WIDTH], (int *)row, WIDTH);
+            pack_png_pixels(row, row);
+        }
+
+        filter_png_row(row, previous, y == 0 ? first_row_filters : row_filters, filtered);
+        *adler = adler32(*adler, filtered, row_bytes + 1);
+
+        // The segment ends on a byte boundary with a sync flush, so segments can be concatenated
+        stream.next_in = filtered;
+        stream.avail_in = row_bytes + 1;
+        if (deflate(&stream, y == rows - 1 ? Z_SYNC_FLUSH : Z_NO_FLUSH) != Z_OK || stream.avail_in != 0) {
+            fprintf(stderr, "Error: deflate failed\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+
+    *length = capacity - stream.avail_out;
+    deflateEnd(&stream);
+    free(pixels);
+    free(filtered);
+    encoded_pixels += (long long)rows * WIDTH;
+    encode_time += MPI_Wtime() - start_time;
+    return segment;
+}
+
+static void send_png_segment(const int *array, int rows) {
+
+    int length;
+    unsigned long adler;
+    unsigned char *segment = deflate_png_rows(array, rows, &length, &adler);
+
+    // Compressed length, uncompressed length and Adler-32, then the segment itself
+    long long header[3] = {length, (long long)rows * (png_pixel_bytes * WIDTH + 1), adler};
+    MPI_Send(header, 3, MPI_LONG_LONG, 0, 6, MPI_COMM_WORLD);
+    MPI_Send(segment, length, MPI_BYTE, 0, 7, MPI_COMM_WORLD);
+    free(segment);
+}
+
+static int write_png_chunk(FILE *fp, const char *type, const unsigned char *data, size_t length) {
+
+    // Length and type, the data, then the CRC-32 of type and data, all numbers big-endian
+    unsigned char header[8] = {length >> 24, length >> 16, length >> 8, length & 255, type[0], type[1], type[2], type[3]};
+    // (crc32 with no data returns the initial value rather than the running one)
+    unsigned long crc = crc32(0L, (const Bytef *)type, 4);
+    if (length > 0) {
+        crc = crc32(crc, data, length);
+    }
+    unsigned char trailer[4] = {crc >> 24, crc >> 16, crc >> 8, crc & 255};
+
+    return fwrite(header, 1, 8, fp) != 8 || (length > 0 && fwrite(data, 1, length, fp) != length) || fwrite(trailer, 1, 4, fp) != 4;
+}
+
+static int write_png_segment(FILE *fp, const int *array, int rows, int source, unsigned long *adler) {
+
+    // Rank 0 compresses its own rows, the other segments are received in order
+    int length;
+    unsigned long segment_adler;
+    long long raw_length;
+    unsigned char *segment;
+    if (source == 0) {
+        segment = deflate_png_rows(array, rows, &length, &segment_adler);
+        raw_length = (long long)rows * (png_pixel_bytes * WIDTH + 1);
+    } else {
+        long long header[3];
+        MPI_Recv(header, 3, MPI_LONG_LONG, source, 6, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        length = header[0];
+        raw_length = header[1];
+        segment_adler = header[2];
+        segment = malloc(length > 0 ? length : 1);
+        if (segment == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        MPI_Recv(segment, length, MPI_BYTE, source, 7, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+
+    // Checksum of the stream so far, extended by the segment
+    *adler = adler32_combine(*adler, segment_adler, raw_length);
+
+    int error = length > 0 && write_png_chunk(fp, "IDAT", segment, length);
+    free(segment);
+    return error;
+}
+
+static void put_little_endian(unsigned char *bytes, unsigned long long value, int length) {
+    for (int i = 0; i < length; i++) {
+        bytes[i] = (value >> (8 * i)) & 255;
+    }
+}
+
+static long long output_header_size(void) {
+
+    // The raw container has a fixed 64-byte header. The BigTIFF header, directory and tile index
+    // are rounded up to 4096 bytes, so the tiles start on a file system block
+    if (MPI_IO_OUTPUT == 2) {
+        return 64;
+    }
+    long long tiles = (long long)((WIDTH + TILE_WIDTH - 1) / TILE_WIDTH) * ((HEIGHT + TILE_HEIGHT - 1) / TILE_HEIGHT);
+    return (16 + 256 + 16 * tiles + 4095) / 4096 * 4096;
+}
+
+static long long output_file_size(void) {
+
+    // TIFF edge tiles are padded to the full tile size
+    if (MPI_IO_OUTPUT == 2) {
+        return output_header_size() + 4LL * WIDTH * HEIGHT;
+    }
+    long long tiles = (long long)((WIDTH + TILE_WIDTH - 1) / TILE_WIDTH) * ((HEIGHT + TILE_HEIGHT - 1) / TILE_HEIGHT);
+    return output_header_size() + tiles * 4 * TILE_WIDTH * TILE_HEIGHT;
+}
+
+static unsigned char *output_header(long long *length) {
+
+    *length = output_header_size();
+    unsigned char *header = calloc(*length, 1);
+    if (header == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    if (MPI_IO_OUTPUT == 2) {
+
+        // Magic, version, then whether the pixels are iteration counts (int32, 0) or RGBA bytes (1),
+        // width, height, MAX_ITERATION, COLOR_CHOICE and the byte offset of the first row.
+        // All numbers little-endian, the pixels row by row from the top
+        memcpy(header, "FRACTRAW", 8);
+        put_little_endian(&header[8], 1, 4);
+        put_little_endian(&header[12], WORKER_COLOR, 4);
+        put_little_endian(&header[16], WIDTH, 8);
+        put_little_endian(&header[24], HEIGHT, 8);
+        put_little_endian(&header[32], MAX_ITERATION, 4);
+        put_little_endian(&header[36], COLOR_CHOICE, 4);
+        put_little_endian(&header[40], *length, 8);
+        return header;
+    }
+
+    // BigTIFF header: little-endian, version 43, 8-byte offsets, first directory at byte 16
+    long long tiles = (long long)((WIDTH + TILE_WIDTH - 1) / TILE_WIDTH) * ((HEIGHT + TILE_HEIGHT - 1) / TILE_HEIGHT);
+    long long tile_bytes = 4LL * TILE_WIDTH * TILE_HEIGHT;
+    long long offsets_start = 16 + 256, counts_start = offsets_start + 8 * tiles;
+    memcpy(header, "II", 2);
+    put_little_endian(&header[2], 43, 2);
+    put_little_endian(&header[4], 8, 2);
+    put_little_endian(&header[8], 16, 8);
+
+    // Directory of 12 entries in tag order: tag, type (3 short, 4 long, 16 long8), count, then
+    // the value itself when it fits in 8 bytes or the offset of the values
+    long long entries[12][4] = {
+        {256, 4, 1, WIDTH},                     // ImageWidth
+        {257, 4, 1, HEIGHT},                    // ImageLength
+        {258, 3, 4, 0x0008000800080008LL},      // BitsPerSample 8, 8, 8, 8
+        {259, 3, 1, 1},                         // Compression: none
+        {262, 3, 1, 2},                         // PhotometricInterpretation: RGB
+        {277, 3, 1, 4},                         // SamplesPerPixel
+        {284, 3, 1, 1},                         // PlanarConfiguration: interleaved
+        {322, 4, 1, TILE_WIDTH},                // TileWidth
+        {323, 4, 1, TILE_HEIGHT},               // TileLength
+        {324, 16, tiles, tiles > 1 ? offsets_start : output_header_size()},    // TileOffsets
+        {325, 16, tiles, tiles > 1 ? counts_start : tile_bytes},              // TileByteCounts
+        {338, 3, 1, 2}                          // ExtraSamples: unassociated alpha
+    };
+    put_little_endian(&header[16], 12, 8);
+    for (int i = 0; i < 12; i++) {
+        unsigned char *entry = &header[24 + 20 * i];
+        put_little_endian(entry, entries[i][0], 2);
+        put_little_endian(&entry[2], entries[i][1], 2);
+        put_little_endian(&entry[4], entries[i][2], 8);
+        put_little_endian(&entry[12], entries[i][3], 8);
+    }
+    // (the next directory offset after the entries stays 0)
+
+    // Tiles are stored in tile order, each at full size, straight after the header
+    for (long long i = 0; i < tiles; i++) {
+        put_little_endian(&header[offsets_start + 8 * i], output_header_size() + i * tile_bytes, 8);
+        put_little_endian(&header[counts_start + 8 * i], tile_bytes, 8);
+    }
+    return header;
+}
+
+static void add_file_runs(FileRun **runs, int *run_count, int *capacity, int row, int x, int length, const int *pixels) {
+
+    // A row of pixels is one run in the raw container. In the TIFF it is cut at the tile columns,
+    // since each tile is stored row by row on its own
+    while (length > 0) {
+        int run_length = length;
+        long long offset = output_header_size() + 4 * ((long long)row * WIDTH + x);
+        if (MPI_IO_OUTPUT == 1) {
+            int tile_columns = (WIDTH + TILE_WIDTH - 1) / TILE_WIDTH;
+            long long tile = (long long)(row / TILE_HEIGHT) * tile_columns + x / TILE_WIDTH;
+            run_length = TILE_WIDTH - x % TILE_WIDTH < length ? TILE_WIDTH - x % TILE_WIDTH : length;
+            offset = output_header_size() + 4 * (tile * TILE_WIDTH * TILE_HEIGHT + (row % TILE_HEIGHT) * TILE_WIDTH + x % TILE_WIDTH);
+        }
+
+        if (*run_count == *capacity) {
+            *capacity = *capacity > 0 ? 2 * *capacity : 1024;
+            *runs = realloc(*runs, sizeof(FileRun) * *capacity);
+            if (*runs == NULL) {
+                fprintf(stderr, "Error: Memory allocation failed\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+        }
+        (*runs)[(*run_count)++] = (FileRun){offset, pixels, run_length};
+
+        x += run_length;
+        pixels += run_length;
+        length -= run_length;
+    }
+}
+
+static int compare_file_runs(const void *a, const void *b) {
+    long long difference = ((const FileRun *)a)->offset - ((const FileRun *)b)->offset;
+    return (difference > 0) - (difference < 0);
+}
+
+static FileRun *local_file_runs(int unique_rows, int tiled, int start_row, int end_row, const int *pixels, const int *tiles, int tile_count,
+                         const int *chunk_rows, int chunk_count, int mirror_start, int mirror_end, const int *mirror_pixels, int *run_count) {
+
+    // Every row this rank holds, in the layout of its schedule: tiles or chunks back to back,
+    // or one block of rows followed by its mirrored rows
+    FileRun *runs = NULL;
+    int capacity = 0;
+    *run_count = 0;
+    if (tiled) {
+        for (int i = 0; i < tile_count; i++) {
+            Tile tile = image_tile(tiles[i], unique_rows);
+            for (int y = 0; y < tile.height; y++) {
+                add_file_runs(&runs, run_count, &capacity, tile.y + y, tile.x, tile.width, pixels);
+                pixels += tile.width;
+            }
+        }
+    } else if (ROW_SCHEDULE == 1 || ROW_SCHEDULE == 2) {
+        for (int i = 0; i < chunk_count; i++) {
+            for (int y = chunk_rows[i]; y < chunk_rows[i] + row_chunk_length(chunk_rows[i], unique_rows); y++) {
+                add_file_runs(&runs, run_count, &capacity, y, 0, WIDTH, pixels);
+                pixels += WIDTH;
+            }
+        }
+    } else {
+        for (int y = start_row; y < end_row; y++) {
+            add_file_runs(&runs, run_count, &capacity, y, 0, WIDTH, &pixels[(y - start_row) * WIDTH]);
+        }
+        for (int y = mirror_start; y < mirror_end; y++) {
+            add_file_runs(&runs, run_count, &capacity, y, 0, WIDTH, &mirror_pixels[(y - mirror_start) * WIDTH]);
+        }
+    }
+
+    // A file view must move forward through the file, so the runs go in file order
+    qsort(runs, *run_count, sizeof(FileRun), compare_file_runs);
+    return runs;
+}
+
+static int open_output_file(const char *filename, MPI_File *file) {
+
+    if (MPI_File_open(MPI_COMM_WORLD, filename, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, file) != MPI_SUCCESS) {
+        return 1;
+    }
+
+    // Full size up front, so the padding of TIFF edge tiles reads as zeros and an old, longer file is cut
+    int error = MPI_File_set_size(*file, output_file_size()) != MPI_SUCCESS;
+
+    // Rank 0 writes the header and tile index, the pixels are written by the ranks that hold them
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (rank == 0) {
+        long long header_length;
+        unsigned char *header = output_header(&header_length);
+        error |= MPI_File_write_at(*file, 0, header, header_length, MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS;
+        free(header);
+    }
+    return error;
+}
+
+static int write_file_runs(MPI_File file, const FileRun *runs, int run_count) {
+
+    // The file view picks out this rank's runs in file order, and the memory type picks up the
+    // same runs in the rank's buffers, so one collective write covers all of them
+    int *lengths = malloc(sizeof(int) * (run_count > 0 ? run_count : 1));
+    MPI_Aint *file_displacements = malloc(sizeof(MPI_Aint) * (run_count > 0 ? run_count : 1));
+    MPI_Aint *memory_displacements = malloc(sizeof(MPI_Aint) * (run_count > 0 ? run_count : 1));
+    if (lengths == NULL || file_displacements == NULL || memory_displacements == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (int i = 0; i < run_count; i++) {
+        lengths[i] = 4 * runs[i].length;
+        file_displacements[i] = runs[i].offset;
+        MPI_Get_address(runs[i].pixels, &memory_displacements[i]);
+    }
+
+    MPI_Datatype file_type, memory_type;
+    MPI_Type_create_hindexed(run_count, lengths, file_displacements, MPI_BYTE, &file_type);
+    MPI_Type_create_hindexed(run_count, lengths, memory_displacements, MPI_BYTE, &memory_type);
+    MPI_Type_commit(&file_type);
+    MPI_Type_commit(&memory_type);
+
+    int error = MPI_File_set_view(file, 0, MPI_BYTE, file_type, "native", MPI_INFO_NULL) != MPI_SUCCESS;
+    error |= MPI_File_write_at_all(file, 0, MPI_BOTTOM, 1, memory_type, MPI_STATUS_IGNORE) != MPI_SUCCESS;
+
+    MPI_Type_free(&file_type);
+    MPI_Type_free(&memory_type);
+    free(lengths);
+    free(file_displacements);
+    free(memory_displacements);
+    return error;
+}
+
+#endif
@@ -0,0 +1,314 @@
+// Row-by-row image file encoders shared by all five programs: libpng, the libpng fast preset, QOI,
+// JPEG and PPM. Include it once, after the IMAGE_ENCODER, PNG_ZLIB_LEVEL, PNG_ZLIB_STRATEGY,
+// PNG_ROW_FILTERS and JPEG_QUALITY #defines. It uses no MPI: functions report errors through their
+// return value, and the MPI programs abort at the call site. Everything here is static, so each
+// program gets its own copy built with its own settings
+#ifndef IMAGE_ENCODER_H
+#define IMAGE_ENCODER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h> // Needed for clock_gettime
+#include <png.h>
+#include <zlib.h> // Needed for the zlib strategies of PNG_ZLIB_STRATEGY
+
+#if IMAGE_ENCODER == 3
+#include <jpeglib.h> // Needed for the JPEG previews of IMAGE_ENCODER 3
+#endif
+
+// Image file written row by row by the encoder of IMAGE_ENCODER
+typedef struct {
+    FILE *fp;
+    int width;                          // Pixels per row
+    png_structp png_ptr;                // libpng encoders
+    png_infop info_ptr;
+#if IMAGE_ENCODER == 3
+    struct jpeg_compress_struct jpeg;   // JPEG encoder
+    struct jpeg_error_mgr jpeg_error;
+#endif
+    unsigned char *buffer;              // Encoded row of the QOI encoder, RGB row of the JPEG and PPM encoders
+    int qoi_index[64];                  // QOI: recently seen pixels by hash, the previous pixel and the length of its run
+    int qoi_previous;
+    int qoi_run;
+} ImageEncoder;
+
+static double encoder_clock(void);
+static void png_encoder_settings(int *level, int *strategy, int *filters);
+static int open_image_encoder(ImageEncoder *encoder, const char *filename, int width, int height);
+static int encode_image_row(ImageEncoder *encoder, png_const_bytep row);
+static int encode_qoi_row(ImageEncoder *encoder, png_const_bytep row);
+static int close_image_encoder(ImageEncoder *encoder);
+
+// Name and file extension of each IMAGE_ENCODER
+static const char *image_encoder_names[5] = {"libpng", "libpng fast preset", "QOI", "JPEG", "PPM"};
+static const char *image_extensions[5] = {"png", "png", "qoi", "jpg", "ppm"};
+
+// Pixels encoded and the time it took, and the size of the files written
+static long long encoded_pixels = 0;
+static double encode_time = 0.0;
+static long long encoded_bytes = 0;
+
+// Colour type of the rows handed to the libpng encoders, and the palette of PNG_COLOR_TYPE_PALETTE.
+// RGBA unless the program sets them before opening the encoder
+static int png_color_type = PNG_COLOR_TYPE_RGBA;
+static png_color png_palette[256];
+static int png_palette_size = 0;
+
+static double encoder_clock(void) {
+
+    // Wall-clock seconds, like MPI_Wtime
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void png_encoder_settings(int *level, int *strategy, int *filters) {
+
+    // The fast preset overrides the PNG_* settings. -1 stays -1, for libpng's own choice
+    *level = IMAGE_ENCODER == 1 ? 1 : PNG_ZLIB_LEVEL;
+    *strategy = IMAGE_ENCODER == 1 ? Z_RLE : PNG_ZLIB_STRATEGY;
+    *filters = IMAGE_ENCODER == 1 ? PNG_FILTER_SUB : PNG_ROW_FILTERS;
+}
+
+static int open_image_encoder(ImageEncoder *encoder, const char *filename, int width, int height) {
+
+    *encoder = (ImageEncoder){0};
+    encoder->width = width;
+    double start_time = encoder_clock();
+
+    // Open file for writing (binary mode)
+    encoder->fp = fopen(filename, "wb");
+    if (!encoder->fp) {
+        fprintf(stderr, "Error opening file for writing\n");
+        return 1;
+    }
+
+    if (IMAGE_ENCODER <= 1) {
+
+        // Create PNG structures
+        encoder->png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+        encoder->info_ptr = encoder->png_ptr ? png_create_info_struct(encoder->png_ptr) : NULL;
+        if (!encoder->info_ptr) {
+            png_destroy_write_struct(&encoder->png_ptr, NULL);
+            fclose(encoder->fp);
+            fprintf(stderr, "Error creating PNG write structures\n");
+            return 1;
+        }
+
+        // Error handling setup
+        if (setjmp(png_jmpbuf(encoder->png_ptr))) {
+            png_destroy_write_struct(&encoder->png_ptr, &encoder->info_ptr);
+            fclose(encoder->fp);
+            fprintf(stderr, "Error during PNG creation\n");
+            return 1;
+        }
+
+        // Set image properties and compression
+        png_set_IHDR(encoder->png_ptr, encoder->info_ptr, width, height, 8, png_color_type, PNG_INTERLACE_NONE,
+                     PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_BASE);
+        if (png_color_type == PNG_COLOR_TYPE_PALETTE) {
+            png_set_PLTE(encoder->png_ptr, encoder->info_ptr, png_palette, png_palette_size);
+        }
+        int level, strategy, filters;
+        png_encoder_settings(&level, &strategy, &filters);
+        if (level != -1) {
+            png_set_compression_level(encoder->png_ptr, level);
+        }
+        if (strategy != -1) {
+            png_set_compression_strategy(encoder->png_ptr, strategy);
+        }
+        if (filters != -1) {
+            png_set_filter(encoder->png_ptr, PNG_FILTER_TYPE_BASE, filters);
+        }
+
+        // Initialize I/O for writing to file, and write the PNG header
+        png_init_io(encoder->png_ptr, encoder->fp);
+        png_write_info(encoder->png_ptr, encoder->info_ptr);
+        encode_time += encoder_clock() - start_time;
+        return 0;
+    }
+
+    // Room for a QOI row at its worst, 5 bytes per pixel, which also holds an RGB row
+    encoder->buffer = malloc(5 * width + 8);
+    if (!encoder->buffer) {
+        fclose(encoder->fp);
+        fprintf(stderr, "Error allocating memory for image data\n");
+        return 1;
+    }
+
+    int error = 0;
+    if (IMAGE_ENCODER == 2) {
+
+        // Magic, big-endian size, 3 channels as alpha is always 255, and the sRGB colour space.
+        // The previous pixel starts as opaque black
+        unsigned char header[14] = {'q', 'o', 'i', 'f', (width >> 24) & 255, (width >> 16) & 255, (width >> 8) & 255, width & 255,
+                                    (height >> 24) & 255, (height >> 16) & 255, (height >> 8) & 255, height & 255, 3, 0};
+        error = fwrite(header, 1, sizeof(header), encoder->fp) != sizeof(header);
+        png_byte black[4] = {0, 0, 0, 255};
+        memcpy(&encoder->qoi_previous, black, sizeof(encoder->qoi_previous));
+
+    } else if (IMAGE_ENCODER == 3) {
+
+#if IMAGE_ENCODER == 3
+        // libjpeg exits with a message on errors
+        encoder->jpeg.err = jpeg_std_error(&encoder->jpeg_error);
+        jpeg_create_compress(&encoder->jpeg);
+        jpeg_stdio_dest(&encoder->jpeg, encoder->fp);
+        encoder->jpeg.image_width = width;
+        encoder->jpeg.image_height = height;
+        encoder->jpeg.input_components = 3;
+        encoder->jpeg.in_color_space = JCS_RGB;
+        jpeg_set_defaults(&encoder->jpeg);
+        jpeg_set_quality(&encoder->jpeg, JPEG_QUALITY, TRUE);
+        jpeg_start_compress(&encoder->jpeg, TRUE);
+#endif
+
+    } else {
+        error = fprintf(encoder->fp, "P6\n%d %d\n255\n", width, height) < 0;
+    }
+
+    if (error) {
+        free(encoder->buffer);
+        fclose(encoder->fp);
+        fprintf(stderr, "Error writing image header\n");
+        return 1;
+    }
+    encode_time += encoder_clock() - start_time;
+    return 0;
+}
+
+static int encode_image_row(ImageEncoder *encoder, png_const_bytep row) {
+
+    // Rows come as rows of png_color_type for the libpng encoders, and as 4-byte RGBA pixels for the others
+    double start_time = encoder_clock();
+    int error = 0;
+    if (IMAGE_ENCODER <= 1) {
+        if (setjmp(png_jmpbuf(encoder->png_ptr))) {
+            fprintf(stderr, "Error during PNG creation\n");
+            return 1;
+        }
+        png_write_row(encoder->png_ptr, row);
+    } else if (IMAGE_ENCODER == 2) {
+        error = encode_qoi_row(encoder, row);
+    } else {
+
+        // JPEG and PPM take RGB
+        for (int x = 0; x < encoder->width; x++) {
+            encoder->buffer[3 * x] = row[4 * x];
+            encoder->buffer[3 * x + 1] = row[4 * x + 1];
+            encoder->buffer[3 * x + 2] = row[4 * x + 2];
+        }
+#if IMAGE_ENCODER == 3
+        JSAMPROW scanline = encoder->buffer;
+        jpeg_write_scanlines(&encoder->jpeg, &scanline, 1);
+#else
+        error = fwrite(encoder->buffer, 3, encoder->width, encoder->fp) != (size_t)encoder->width;
+#endif
+    }
+    if (error) {
+        fprintf(stderr, "Error writing image file\n");
+        return 1;
+    }
+    encoded_pixels += encoder->width;
+    encode_time += encoder_clock() - start_time;
+    return 0;
+}
+
+static int encode_qoi_row(ImageEncoder *encoder, png_const_bytep row) {
+
+    // Each pixel becomes the first of these that fits: part of a run of the previous pixel, an index
+    // into the recently seen pixels, a small difference from the previous pixel, or the full colour.
+    // A run can go on into the next row, so it is only written when it ends
+    unsigned char *out = encoder->buffer;
+    int length = 0;
+    for (int x = 0; x < encoder->width; x++) {
+        const png_byte *rgba = &row[4 * x];
+        int pixel;
+        memcpy(&pixel, rgba, sizeof(pixel));
+
+        if (pixel == encoder->qoi_previous) {
+            if (++encoder->qoi_run == 62) {
+                out[length++] = 0xc0 | 61;
+                encoder->qoi_run = 0;
+            }
+            continue;
+        }
+        if (encoder->qoi_run > 0) {
+            out[length++] = 0xc0 | (encoder->qoi_run - 1);
+            encoder->qoi_run = 0;
+        }
+
+        int hash = (rgba[0] * 3 + rgba[1] * 5 + rgba[2] * 7 + rgba[3] * 11) % 64;
+        const png_byte *previous = (const png_byte *)&encoder->qoi_previous;
+        if (encoder->qoi_index[hash] == pixel) {
+            out[length++] = hash;
+        } else if (rgba[3] != previous[3]) {
+            out[length++] = 0xff;
+            memcpy(&out[length], rgba, 4);
+            length += 4;
+        } else {
+
+            // Differences wrap around like the bytes themselves
+            signed char red = rgba[0] - previous[0], green = rgba[1] - previous[1], blue = rgba[2] - previous[2];
+            int red_green = red - green, blue_green = blue - green;
+            if (red >= -2 && red <= 1 && green >= -2 && green <= 1 && blue >= -2 && blue <= 1) {
+                out[length++] = 0x40 | (red + 2) << 4 | (green + 2) << 2 | (blue + 2);
+            } else if (green >= -32 && green <= 31 && red_green >= -8 && red_green <= 7 && blue_green >= -8 && blue_green <= 7) {
+                out[length++] = 0x80 | (green + 32);
+                out[length++] = (red_green + 8) << 4 | (blue_green + 8);
+            } else {
+                out[length++] = 0xfe;
+                memcpy(&out[length], rgba, 3);
+                length += 3;
+            }
+        }
+        encoder->qoi_index[hash] = pixel;
+        encoder->qoi_previous = pixel;
+    }
+
+    return fwrite(out, 1, length, encoder->fp) != (size_t)length;
+}
+
+static int close_image_encoder(ImageEncoder *encoder) {
+
+    double start_time = encoder_clock();
+    int error = 0;
+    if (IMAGE_ENCODER <= 1) {
+
+        // Write the end of the PNG information
+        if (setjmp(png_jmpbuf(encoder->png_ptr))) {
+            png_destroy_write_struct(&encoder->png_ptr, &encoder->info_ptr);
+            fclose(encoder->fp);
+            return 1;
+        }
+        png_write_end(encoder->png_ptr, encoder->info_ptr);
+        png_destroy_write_struct(&encoder->png_ptr, &encoder->info_ptr);
+
+    } else if (IMAGE_ENCODER == 2) {
+
+        // The run still open, then the end marker: seven zeros and a one
+        unsigned char end[9] = {0};
+        int length = 0;
+        if (encoder->qoi_run > 0) {
+            end[length++] = 0xc0 | (encoder->qoi_run - 1);
+        }
+        length += 7;
+        end[length++] = 1;
+        error = fwrite(end, 1, length, encoder->fp) != (size_t)length;
+
+    } else if (IMAGE_ENCODER == 3) {
+#if IMAGE_ENCODER == 3
+        jpeg_finish_compress(&encoder->jpeg);
+        jpeg_destroy_compress(&encoder->jpeg);
+#endif
+    }
+
+    encoded_bytes += ftell(encoder->fp);
+    error |= fclose(encoder->fp) != 0;
+    free(encoder->buffer);
+    encode_time += encoder_clock() - start_time;
+    return error;
+}
+
+#endif
@@ -1,69 +1,2002 @@
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h> // Needed for INT_MAX
 #include <unistd.h> // Needed for usleep function
 #include <time.h> // Needed for time functions
 #include <math.h>
 #include <png.h>
+#include <zlib.h> // Needed for the deflate segments of PARALLEL_DEFLATE
+#include <pthread.h> // Needed for the worker threads of THREADS_PER_RANK
+#include <sys/stat.h> // Needed for the DZI_OUTPUT directories
+#include <errno.h> // Needed for EEXIST
+
+// The SIMD kernels are compiled for every x86 target and chosen at runtime,
+// so one binary runs on every node whatever its CPU generation
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define X86_KERNELS
+#include <immintrin.h> // Needed for the SIMD escape-time kernels
+#endif
+
+// Fusing multiplies and adds changes the rounding of z^2 + c, and with it the
+// iteration counts, so every kernel variant keeps them separate
+#pragma GCC optimize ("fp-contract=off")
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define WIDTH 10000
+#define HEIGHT 10000
+#define MAX_ITERATION 1000
+
+#define REAL_NUMBER -0.726990
+#define IMAGINARY_NUMBER 0.188990
+
+// Region of the complex plane shown in the image
+#define VIEW_XMIN (-1.75)
+#define VIEW_XMAX 1.75
+#define VIEW_YMIN (-1.75)
+#define VIEW_YMAX 1.75
+
+// so far 1, 3, 16 are actually kind of nice lolol 
+// 14 are a bit odd 
+#define COLOR_CHOICE 16
+
+// Stop iterating orbits that return to an earlier point, i.e. are caught in a cycle (1 = on, 0 = off)
+#define PERIODICITY_CHECK 0
+
+// Distance (in each coordinate) within which the orbit counts as back at its checkpoint
+#define PERIODICITY_TOLERANCE 1e-12
+
+// Stop interior pixels once their orbit reaches the attracting cycle of the critical point (1 = on, 0 = off)
+#define ATTRACTING_CYCLE_TRAP 1
+
+// Compute only the bottom half of a view centred on 0 and fill the top half from the
+// point symmetry z -> -z of every Julia set (1 = on, 0 = off)
+#define SYMMETRY_MODE 0
+
+// Engine for each rank's rows: 0 = row kernels, 1 = Mariani-Silver rectangle subdivision, which
+// computes the border of a rectangle and fills it when the border has a single value
+#define MARIANI_SILVER 0
+
+// Rectangles no larger than this in either direction are computed pixel by pixel (at least 3)
+#define MARIANI_SILVER_MIN_SIZE 16
+
+// Interior pixels checked against a uniform border before the rectangle is filled (0 = trust the border)
+#define MARIANI_SILVER_GUARD_SAMPLES 4
+
+// Deep zoom: perturbation engine for views too small for plain doubles (1 = on, 0 = off). One
+// reference orbit is iterated at DEEP_ZOOM_LIMBS * 32 bits and every pixel iterates its offset from it
+#define DEEP_ZOOM 0
+
+// Centre of the deep zoom view, as decimal strings so they can carry more digits than a double
+#define DEEP_ZOOM_CENTER_REAL "1.49299832368269866333064728680544516149277220585582"
+#define DEEP_ZOOM_CENTER_IMAG "-0.09516128854029646853533192654338154738350942320963"
+
+// Half the height of the deep zoom view (pixels are square)
+#define DEEP_ZOOM_RADIUS 1e-20
+
+// 32-bit limbs per coordinate of the reference orbit; keep 32 * (DEEP_ZOOM_LIMBS - 1) well above -log2(DEEP_ZOOM_RADIUS)
+#define DEEP_ZOOM_LIMBS 8
+
+// A pixel whose orbit comes this much closer to 0 than the reference's (relative) is a glitch
+#define DEEP_ZOOM_GLITCH_TOLERANCE 1e-3
+
+// References each rank may use, counting the broadcast one, before leftover glitches are given up on
+#define DEEP_ZOOM_MAX_REFERENCES 32
+
+// Skip the first iterations with a cubic series in the pixel offset (1 = on, 0 = off), and the
+// relative error allowed in it
+#define DEEP_ZOOM_SERIES_APPROXIMATION 1
+#define DEEP_ZOOM_SERIES_TOLERANCE 1e-6
+
+// Double-double kernels: every coordinate is an unevaluated sum hi + lo of two doubles, about
+// 106 bits, for views a little too small for plain doubles (0 = off, 1 = always, 2 = automatic)
+#define DOUBLE_DOUBLE_MODE 2
+
+// In automatic mode, switch to double-double when the pixel spacing drops below this fraction
+// of the largest coordinate in the view (double resolves about 2.2e-16 of it)
+#define DOUBLE_DOUBLE_SPACING 1e-11
+
+// Row distribution: 0 = one contiguous block per rank, 1 = dynamic, where each rank takes the
+// next ROW_CHUNK_SIZE rows from a shared counter on rank 0 whenever it finishes a chunk,
+// 2 = block-cyclic, where rank r takes chunks r, r + P, r + 2P... of P ranks, 3 = one block
+// per rank like 0, but with the blocks sized by the estimated cost from a coarse preview
+#define ROW_SCHEDULE 0
+
+// Rows per chunk in the dynamic and block-cyclic schedules (1 makes the block-cyclic schedule cyclic)
+#define ROW_CHUNK_SIZE 8
+
+// Print how long each rank spent computing its rows (1 = on, 0 = off)
+#define RANK_TIMING 0
+
+// The cost preview iterates every COST_PREVIEW_SCALE-th pixel of every COST_PREVIEW_SCALE-th row
+#define COST_PREVIEW_SCALE 16
+
+// Worker threads per rank for the row engine (1 = none). Each thread takes square tiles of
+// THREAD_TILE_SIZE pixels from its own deque, and steals from the other threads when it runs out
+#define THREADS_PER_RANK 1
+#define THREAD_TILE_SIZE 32
+
+// Deal out TILE_WIDTH x TILE_HEIGHT tiles instead of full-width rows (1 = on, 0 = off). The row
+// schedule then applies to tiles: 0 and 3 give each rank a run of consecutive tiles, 1 hands
+// out one tile at a time from the shared counter and 2 deals them out cyclically
+#define TILE_DECOMPOSITION 0
+#define TILE_WIDTH 256
+#define TILE_HEIGHT 256
+
+// Strips rank 0 accepts ahead of their turn in the one-block-per-rank schedules. Strips are taken
+// in the order the ranks finish and held until every earlier strip has been written
+#define GATHER_REORDER_STRIPS 4
+
+// Every rank turns its iteration counts into RGBA pixels right after computing them, in the
+// same buffer, and rank 0 only encodes (1 = on, 0 = off)
+#define WORKER_COLOR 0
+
+// Every rank filters and deflates its own rows into a segment of the PNG data stream, and rank 0
+// only writes the segments out in order (1 = on, 0 = off). Needs ROW_SCHEDULE 0 or 3 without tiles
+#define PARALLEL_DEFLATE 0
+
+// Every rank writes its own pixels into one shared file with collective MPI-IO, and rank 0 only
+// writes the header, so nothing is gathered (0 = PNG through rank 0, 1 = tiled BigTIFF with
+// TILE_WIDTH x TILE_HEIGHT tiles, 2 = raw container). TIFF tiles must be multiples of 16 pixels
+#define MPI_IO_OUTPUT 0
+
+// Rows per message when the strips or chunks of any ROW_SCHEDULE are streamed to rank 0 (0 = whole).
+// A rank sends each message only once rank 0 has granted it a credit, which rank 0 does when one of
+// its STREAM_CREDITS reusable buffers is free, so the received rows held on rank 0 do not grow with the image
+#define STREAM_ROWS 0
+#define STREAM_CREDITS 4
+
+// Compute and write the image in chunks of GIGAPIXEL_CHUNK_ROWS rows, dealt out to the ranks in turn
+// (1 = on, 0 = off). A rank holds one chunk at a time and rank 0 at most STREAM_CREDITS more, so
+// images far larger than memory can be made. Without it, WIDTH x HEIGHT must stay below 2^31 pixels
+#define GIGAPIXEL_MODE 0
+#define GIGAPIXEL_CHUNK_ROWS 64
+
+// Write PNG output as an 8-bit palette image when COLOR_CHOICE has at most 256 distinct colours for
+// the counts 0 .. MAX_ITERATION, and as RGB without alpha otherwise (1 = on, 0 = RGBA, the default)
+#define PALETTE_OUTPUT 0
+
+// Encoder of the image file (0 = libpng, 1 = libpng fast preset, 2 = QOI, 3 = JPEG preview, 4 = PPM).
+// The fast preset is zlib level 1 with run-length matching and the Sub filter, for intermediate renders
+// where wall time matters more than size. JPEG needs -ljpeg. PPM is binary RGB without compression
+#define IMAGE_ENCODER 0
+
+// zlib level (0 to 9), zlib strategy (0 = default, 1 = filtered, 2 = Huffman only, 3 = run-length) and
+// row filters (PNG_FILTER_* flags) of IMAGE_ENCODER 0 and PARALLEL_DEFLATE. -1 keeps libpng's choice
+#define PNG_ZLIB_LEVEL -1
+#define PNG_ZLIB_STRATEGY -1
+#define PNG_ROW_FILTERS -1
+
+// Quality of IMAGE_ENCODER 3 (1 to 100)
+#define JPEG_QUALITY 85
+
+// Write a Deep Zoom (DZI) pyramid for the OpenSeadragon viewer in html_viewer instead of one image
+// (1 = on, 0 = off). Each rank encodes the tiles that start in its own rows and downsamples them into
+// the next level, so the full-resolution image is never assembled. Tiles are DZI_TILE_SIZE pixels,
+// plus DZI_OVERLAP pixels shared with each neighbour, and use the PNG or JPEG encoder of IMAGE_ENCODER
+#define DZI_OUTPUT 0
+#define DZI_TILE_SIZE 254
+#define DZI_OVERLAP 1
+
+#include "image_encoder.h"
+#include "fractal_common.h"
+
+// Block of rows shared by the worker threads of calculate_julia_array_range_threaded
+typedef struct {
+    int width, start_row, end_row;
+    int *result;
+    double real, imaginary;
+    int tile_columns;       // Tiles across the width of the block
+    TileDeque deques[THREADS_PER_RANK];
+} TilePool;
+
+typedef struct {
+    TilePool *pool;
+    int thread;             // 0 is the thread that called calculate_julia_array_range_threaded
+    long long periodicity_resolved_pixels;  // Counts of the thread, handed back when it finishes
+    long long trap_resolved_pixels;
+} TileWorker;
+
+// Attracting cycle of z^2 + c found from the orbit of the critical point 0
+typedef struct {
+    int found;          // 1 when c has an attracting cycle and a trap disc around it was verified
+    int period;         // Length of the cycle
+    double multiplier;  // |(f^period)'| along the cycle, below 1 for an attracting cycle
+    Complex point;      // Point of the cycle the trap disc is centred on
+    double radius;      // Every orbit that enters the disc converges to the cycle
+} AttractingCycle;
+
+void calculate_julia_array_range(int width, int start_row, int end_row, int *result, double real, double imaginary);
+void calculate_julia_array_range_scalar(int width, int start_row, int end_row, int *result, double real, double imaginary, const int *pixels, int pixel_count);
+int julia_pixel_value(int width, int x, int y, double real, double imaginary);
+void calculate_julia_array_range_mariani_silver(int width, int start_row, int end_row, int *result, double real, double imaginary);
+void compute_reference_orbit(Fixed reference_real, Fixed reference_imag, ReferenceOrbit *reference);
+void series_coefficients(const ReferenceOrbit *reference, int iterations, Complex *coefficients);
+int series_matches_probes(const ReferenceOrbit *reference, int iterations, const Complex *coefficients, double half_width, double half_height);
+void compute_series_approximation(ReferenceOrbit *reference, double half_width, double half_height);
+int julia_perturbation_value(const ReferenceOrbit *reference, int start, double delta_real, double delta_imag, int *glitched);
+void calculate_julia_array_range_perturbation(int width, int start_row, int end_row, int *result, const ReferenceOrbit *reference);
+#ifdef X86_KERNELS
+__attribute__((target("sse2"))) void calculate_julia_array_range_sse2(int width, int start_row, int end_row, int *result, double real, double imaginary, const int *pixels, int pixel_count);
+__attribute__((target("avx2"))) void calculate_julia_array_range_avx2(int width, int start_row, int end_row, int *result, double real, double imaginary, const int *pixels, int pixel_count);
+__attribute__((target("avx512f"))) void calculate_julia_array_range_avx512(int width, int start_row, int end_row, int *result, double real, double imaginary, const int *pixels, int pixel_count);
+#endif
+void select_julia_kernel(int rank);
+#ifdef DOUBLE_DOUBLE_KERNELS
+KERNEL_INLINE void julia_double_double_lanes(int width, int start_row, int end_row, int *result, double real, double imaginary, const int *pixels, int pixel_count);
+void calculate_julia_array_range_double_double(int width, int start_row, int end_row, int *result, double real, double imaginary, const int *pixels, int pixel_count);
+#ifdef X86_KERNELS
+__attribute__((target("avx2"))) void calculate_julia_array_range_double_double_avx2(int width, int start_row, int end_row, int *result, double real, double imaginary, const int *pixels, int pixel_count);
+__attribute__((target("avx512f"))) void calculate_julia_array_range_double_double_avx512(int width, int start_row, int end_row, int *result, double real, double imaginary, const int *pixels, int pixel_count);
+#endif
+#endif
+void prepare_julia_cycle(double real, double imaginary);
+KERNEL_INLINE int next_julia_pixel(int width, int start_row, const int *pixels, int total_pixels, int *next_pixel, double *z_real, double *z_imag);
+AttractingCycle find_attracting_cycle(double real, double imaginary);
+int trap_disc_maps_inside(Complex centre, double radius, int period, double shrink, double real, double imaginary);
+int view_is_symmetric(void);
+void mirror_julia_rows(int width, int start_row, int mirror_start, int mirror_end, const int *source, int *result, double real, double imaginary);
+void calculate_julia_array_range_threaded(int width, int start_row, int end_row, int *result, double real, double imaginary);
+void *julia_tile_worker(void *argument);
+int take_tile(TilePool *pool, int thread);
+void calculate_julia_block(int start_row, int end_row, int *result, const ReferenceOrbit *reference);
+int *calculate_julia_rows_dynamic(int unique_rows, const ReferenceOrbit *reference, int **chunk_rows, int *chunk_count, int *row_count);
+int *calculate_julia_row_chunks(int unique_rows, const ReferenceOrbit *reference, const int *chunk_rows, int chunk_count, int *row_count);
+void calculate_julia_tile(Tile tile, int *result, int *row, int *pixels);
+int *calculate_julia_tiles(int unique_rows, const int *tiles, int tile_count, int *pixel_count);
+int *calculate_julia_tiles_dynamic(int unique_rows, int **tiles, int *tile_count, int *pixel_count);
+double *estimate_julia_row_costs(int rank, int size, int unique_rows);
+void send_gigapixel_chunks(int rank, int size, const ReferenceOrbit *reference, double *compute_time, int *row_count);
+void write_gigapixel_chunks(ImageEncoder *encoder, int size, const ReferenceOrbit *reference, png_bytep row_data,
+                            unsigned long long *current_pixel, double *compute_time, int *row_count);
+int write_gigapixel_file(const char *filename, int rank, int size, const ReferenceOrbit *reference, double *compute_time, int *row_count);
+void send_gigapixel_chunks(int rank, int size, const ReferenceOrbit *reference, double *compute_time, int *row_count) {
+
+    int chunk_rows = gigapixel_chunk_rows();
+    int *chunk = malloc(sizeof(int) * (size_t)chunk_rows * WIDTH);
+    if (chunk == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // Chunks rank, rank + size, rank + 2 * size... Each is sent once rank 0 grants its credit,
+    // then the buffer is reused for the next one
+    *compute_time = 0.0;
+    *row_count = 0;
+    for (int start_row = rank * chunk_rows; start_row < HEIGHT; start_row += size * chunk_rows) {
+        int end_row = start_row + chunk_rows < HEIGHT ? start_row + chunk_rows : HEIGHT;
+        double compute_start_time = MPI_Wtime();
+        calculate_julia_block(start_row, end_row, chunk, reference);
+        *compute_time += MPI_Wtime() - compute_start_time;
+        *row_count += end_row - start_row;
+
+        MPI_Recv(NULL, 0, MPI_INT, 0, 8, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Send(chunk, (end_row - start_row) * WIDTH, MPI_INT, 0, 9, MPI_COMM_WORLD);
+    }
+
+    free(chunk);
+}
+
+void write_gigapixel_chunks(ImageEncoder *encoder, int size, const ReferenceOrbit *reference, png_bytep row_data,
+                            unsigned long long *current_pixel, double *compute_time, int *row_count) {
+
+    int chunk_rows = gigapixel_chunk_rows();
+    int chunk_count = (HEIGHT + chunk_rows - 1) / chunk_rows;
+    size_t chunk_pixels = (size_t)chunk_rows * WIDTH;
+
+    // One buffer for rank 0's own chunks, and a ring of STREAM_CREDITS for the chunks of the
+    // other ranks, in write order: the oldest at first_buffer, the others behind it with their
+    // receives posted and their credits granted
+    int *own_chunk = malloc(sizeof(int) * chunk_pixels);
+    int *buffers = malloc(sizeof(int) * STREAM_CREDITS * chunk_pixels);
+    if (own_chunk == NULL || buffers == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Request buffer_requests[STREAM_CREDITS];
+    int first_buffer = 0, buffers_in_use = 0;
+    int next_credit = 0;
+
+    *compute_time = 0.0;
+    *row_count = 0;
+    for (int i = 0; i < chunk_count; i++) {
+
+        // Grant credits for the next chunks of the other ranks while there are free buffers
+        for (; buffers_in_use < STREAM_CREDITS && next_credit < chunk_count; next_credit++) {
+            if (next_credit % size == 0) {
+                continue;
+            }
+            int buffer = (first_buffer + buffers_in_use) % STREAM_CREDITS;
+            int rows = (next_credit + 1) * chunk_rows < HEIGHT ? chunk_rows : HEIGHT - next_credit * chunk_rows;
+            MPI_Irecv(&buffers[buffer * chunk_pixels], rows * WIDTH, MPI_INT, next_credit % size, 9, MPI_COMM_WORLD, &buffer_requests[buffer]);
+            MPI_Send(NULL, 0, MPI_INT, next_credit % size, 8, MPI_COMM_WORLD);
+            buffers_in_use++;
+        }
+
+        // Rank 0 computes its own chunks when their turn comes, the others are already on their way
+        int start_row = i * chunk_rows;
+        int end_row = start_row + chunk_rows < HEIGHT ? start_row + chunk_rows : HEIGHT;
+        if (i % size == 0) {
+            double compute_start_time = MPI_Wtime();
+            calculate_julia_block(start_row, end_row, own_chunk, reference);
+            *compute_time += MPI_Wtime() - compute_start_time;
+            *row_count += end_row - start_row;
+            write_image_rows(encoder, own_chunk, end_row - start_row, row_data, current_pixel);
+        } else {
+            MPI_Wait(&buffer_requests[first_buffer], MPI_STATUS_IGNORE);
+            write_image_rows(encoder, &buffers[first_buffer * chunk_pixels], end_row - start_row, row_data, current_pixel);
+            first_buffer = (first_buffer + 1) % STREAM_CREDITS;
+            buffers_in_use--;
+        }
+    }
+
+    free(own_chunk);
+    free(buffers);
+}
+
+int write_gigapixel_file(const char *filename, int rank, int size, const ReferenceOrbit *reference, double *compute_time, int *row_count) {
+
+    int chunk_rows = gigapixel_chunk_rows();
+    int chunk_count = (HEIGHT + chunk_rows - 1) / chunk_rows;
+    int *chunk = malloc(sizeof(int) * (size_t)chunk_rows * WIDTH);
+    if (chunk == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    MPI_File file;
+    int error = open_output_file(filename, &file);
+
+    // In every round each rank computes its next chunk, then all of them write together. The
+    // write is collective, so a rank that has run out of chunks still joins in with nothing
+    *compute_time = 0.0;
+    *row_count = 0;
+    for (int round = 0; round < (chunk_count + size - 1) / size; round++) {
+
+        FileRun *runs = NULL;
+        int run_count = 0, capacity = 0;
+        int start_row = (round * size + rank) * chunk_rows;
+        if (start_row < HEIGHT) {
+            int end_row = start_row + chunk_rows < HEIGHT ? start_row + chunk_rows : HEIGHT;
+            double compute_start_time = MPI_Wtime();
+            calculate_julia_block(start_row, end_row, chunk, reference);
+            *compute_time += MPI_Wtime() - compute_start_time;
+            *row_count += end_row - start_row;
+
+            // The TIFF holds RGBA pixels, the raw container whatever the ranks hold
+            if (MPI_IO_OUTPUT == 1 && !WORKER_COLOR) {
+                color_pixels(chunk, chunk, (end_row - start_row) * WIDTH);
+            }
+            for (int y = start_row; y < end_row; y++) {
+                add_file_runs(&runs, &run_count, &capacity, y, 0, WIDTH, &chunk[(size_t)(y - start_row) * WIDTH]);
+            }
+            qsort(runs, run_count, sizeof(FileRun), compare_file_runs);
+        }
+
+        error |= write_file_runs(file, runs, run_count);
+        free(runs);
+    }
+
+    error |= MPI_File_close(&file) != MPI_SUCCESS;
+    free(chunk);
+    return error;
+}
+
+void map_to_color(int iteration, int *red, int *green, int *blue, int color_choice);
+double hue_to_rgb(double hue, double saturation, double lightness);
+
+
+// Trap used by the kernels when ATTRACTING_CYCLE_TRAP is on, and the pixels this rank resolved with it
+AttractingCycle julia_cycle = {.found = 0};
+_Thread_local long long trap_resolved_pixels = 0;
+
+// Row kernel used by calculate_julia_array_range and the Mariani-Silver engine, chosen by select_julia_kernel
+void (*julia_kernel)(int width, int start_row, int end_row, int *result, double real, double imaginary, const int *pixels, int pixel_count) = calculate_julia_array_range_scalar;
+const char *julia_kernel_name = "scalar";
+
+void select_julia_kernel(int rank) {
+
+    char features[64] = "";
+
+#ifdef X86_KERNELS
+    __builtin_cpu_init();
+
+    // Record what this CPU offers, whether or not a kernel uses it
+    if (__builtin_cpu_supports("sse2")) strcat(features, " sse2");
+    if (__builtin_cpu_supports("avx2")) strcat(features, " avx2");
+    if (__builtin_cpu_supports("avx512f")) strcat(features, " avx512f");
+    if (__builtin_cpu_supports("fma")) strcat(features, " fma");
+
+    // Pick the widest vector kernel the CPU can run. FMA is detected but never
+    // used, so ranks on different CPU generations produce identical rows
+    if (__builtin_cpu_supports("avx512f")) {
+        julia_kernel = calculate_julia_array_range_avx512;
+        julia_kernel_name = "avx512";
+    } else if (__builtin_cpu_supports("avx2")) {
+        julia_kernel = calculate_julia_array_range_avx2;
+        julia_kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        julia_kernel = calculate_julia_array_range_sse2;
+        julia_kernel_name = "sse2";
+    }
+
+    // The colour stage gathers 16 or 8 table entries at a time
+    if (__builtin_cpu_supports("avx512f")) {
+        color_kernel = color_pixels_avx512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        color_kernel = color_pixels_avx2;
+    }
+#endif
+
+#ifdef DOUBLE_DOUBLE_KERNELS
+    // Views too small for doubles switch to the double-double kernel for the same target
+    if (DOUBLE_DOUBLE_MODE == 1 || (DOUBLE_DOUBLE_MODE == 2 && view_needs_double_double())) {
+        julia_kernel = calculate_julia_array_range_double_double;
+        julia_kernel_name = "double-double";
+#ifdef X86_KERNELS
+        if (__builtin_cpu_supports("avx512f")) {
+            julia_kernel = calculate_julia_array_range_double_double_avx512;
+            julia_kernel_name = "avx512 double-double";
+        } else if (__builtin_cpu_supports("avx2")) {
+            julia_kernel = calculate_julia_array_range_double_double_avx2;
+            julia_kernel_name = "avx2 double-double";
+        }
+#endif
+    }
+#else
+    if (DOUBLE_DOUBLE_MODE == 1 || (DOUBLE_DOUBLE_MODE == 2 && view_needs_double_double())) {
+        fprintf(stderr, "Rank %d: double-double kernels need GCC vector extensions, the view is rendered in double\n", rank);
+    }
+#endif
+
+    printf("Rank %d: CPU features:%s, using %s kernel\n", rank, features[0] ? features : " none", julia_kernel_name);
+}
+
+void calculate_julia_array_range(int width, int start_row, int end_row, int *result, double real, double imaginary) {
+    prepare_julia_cycle(real, imaginary);
+    julia_kernel(width, start_row, end_row, result, real, imaginary, NULL, 0);
+}
+
+void prepare_julia_cycle(double real, double imaginary) {
+
+    // Find the attracting cycle once per render (i.e. once per constant)
+    static int cycle_ready = 0;
+    static double cycle_real, cycle_imaginary;
+    if (ATTRACTING_CYCLE_TRAP && (!cycle_ready || cycle_real != real || cycle_imaginary != imaginary)) {
+        julia_cycle = find_attracting_cycle(real, imaginary);
+        cycle_real = real;
+        cycle_imaginary = imaginary;
+        cycle_ready = 1;
+    }
+}
+
+AttractingCycle find_attracting_cycle(double real, double imaginary) {
+
+    AttractingCycle cycle = {.found = 0};
+    Complex z = {.real = 0.0, .imag = 0.0};
+
+    // Let the critical orbit settle onto its cycle. If it escapes, c is outside the
+    // Mandelbrot set and the Julia set has no interior
+    for (int i = 0; i < 100 * MAX_ITERATION; i++) {
+        double temp = z.real * z.real - z.imag * z.imag + real;
+        z.imag = 2.0 * z.real * z.imag + imaginary;
+        z.real = temp;
+        if (z.real * z.real + z.imag * z.imag > 4.0) {
+            return cycle;
+        }
+    }
+
+    // The period is the first time the orbit comes back to where it is now
+    Complex start = z;
+    for (int period = 1; period <= MAX_ITERATION && !cycle.period; period++) {
+        double temp = z.real * z.real - z.imag * z.imag + real;
+        z.imag = 2.0 * z.real * z.imag + imaginary;
+        z.real = temp;
+        if (fabs(z.real - start.real) < 1e-9 && fabs(z.imag - start.imag) < 1e-9) {
+            cycle.period = period;
+        }
+    }
+    if (!cycle.period) {
+        return cycle;
+    }
+
+    // Multiplier of the cycle: the product of f'(z) = 2z over its points
+    Complex derivative = {.real = 1.0, .imag = 0.0};
+    z = start;
+    for (int i = 0; i < cycle.period; i++) {
+        double temp = derivative.real * 2.0 * z.real - derivative.imag * 2.0 * z.imag;
+        derivative.imag = derivative.real * 2.0 * z.imag + derivative.imag * 2.0 * z.real;
+        derivative.real = temp;
+        temp = z.real * z.real - z.imag * z.imag + real;
+        z.imag = 2.0 * z.real * z.imag + imaginary;
+        z.real = temp;
+    }
+    cycle.multiplier = sqrt(derivative.real * derivative.real + derivative.imag * derivative.imag);
+    if (cycle.multiplier >= 1.0) {
+        return cycle;
+    }
+
+    // Largest disc around the cycle point that f^period maps strictly inside itself.
+    // Orbits entering such a disc stay in it and converge to the cycle
+    double shrink = (1.0 + cycle.multiplier) / 2.0;
+    for (double radius = 0.25; radius > 1e-12; radius /= 2.0) {
+        if (trap_disc_maps_inside(start, radius, cycle.period, shrink, real, imaginary)) {
+            cycle.found = 1;
+            cycle.point = start;
+            cycle.radius = radius;
+            break;
+        }
+    }
+
+    return cycle;
+}
+
+int trap_disc_maps_inside(Complex centre, double radius, int period, double shrink, double real, double imaginary) {
+
+    // f^period is holomorphic, so the image of the disc is bounded by the image of its
+    // circle. Check that points around the circle land within shrink * radius of the centre
+    for (int i = 0; i < 256; i++) {
+        double angle = 2.0 * M_PI * i / 256;
+        Complex z = {.real = centre.real + radius * cos(angle), .imag = centre.imag + radius * sin(angle)};
+
+        for (int k = 0; k < period; k++) {
+            double temp = z.real * z.real - z.imag * z.imag + real;
+            z.imag = 2.0 * z.real * z.imag + imaginary;
+            z.real = temp;
+        }
+
+        double distance = sqrt((z.real - centre.real) * (z.real - centre.real) + (z.imag - centre.imag) * (z.imag - centre.imag));
+        if (distance >= shrink * radius) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+void calculate_julia_array_range_scalar(int width, int start_row, int end_row, int *result, double real, double imaginary, const int *pixels, int pixel_count) {
+
+    // Either the listed pixels of the block or all of it
+    int total_pixels = pixels ? pixel_count : width * (end_row - start_row);
+
+    for (int i = 0; i < total_pixels; i++) {
+        int pixel = pixels ? pixels[i] : i;
+        result[pixel] = julia_pixel_value(width, pixel % width, start_row + pixel / width, real, imaginary);
+    }
+}
+
+int julia_pixel_value(int width, int x, int y, double real, double imaginary) {
+    
+    // Define constant for Julia set
+    Complex constant = {.real = real, .imag = imaginary}; // Example constant
+
+    // Map pixel coordinates (x, y) directly to the rectangular region in the complex plane
+    // The complex plane is mapped to a rectangular region defined by:
+    // - Real part (x-axis): Range from VIEW_XMIN (leftmost) to VIEW_XMAX (rightmost)
+    // - Imaginary part (y-axis): Range from VIEW_YMIN (bottom) to VIEW_YMAX (top)
+    // The width and height of the rectangular region are adjusted to match the aspect ratio of the image.
+    Complex z = {.real = x / (double)width * (VIEW_XMAX - VIEW_XMIN) + VIEW_XMIN, .imag = y / (double)HEIGHT * (VIEW_YMAX - VIEW_YMIN) + VIEW_YMIN};
+    int iteration = 0;
+
+    // Checkpoint for the periodicity check, moved to the current point after 1, 2, 4, 8... iterations
+    Complex checkpoint = z;
+    int check_interval = 1, check_steps = 0;
+
+    while (z.real * z.real + z.imag * z.imag <= 4.0 && iteration < MAX_ITERATION) {
+        double temp = z.real * z.real - z.imag * z.imag + constant.real;
+        z.imag = 2.0 * z.real * z.imag + constant.imag;
+        z.real = temp;
+        iteration++;
+
+        if (ATTRACTING_CYCLE_TRAP && julia_cycle.found) {
+
+            // Orbit reached the attracting cycle and will stay on it
+            double distance_real = z.real - julia_cycle.point.real;
+            double distance_imag = z.imag - julia_cycle.point.imag;
+            if (distance_real * distance_real + distance_imag * distance_imag < julia_cycle.radius * julia_cycle.radius) {
+                iteration = MAX_ITERATION;
+                trap_resolved_pixels++;
+                break;
+            }
+        }
+
+        if (PERIODICITY_CHECK) {
+
+            // Orbit came back to the checkpoint, so it is caught in a cycle and never escapes
+            if (fabs(z.real - checkpoint.real) < PERIODICITY_TOLERANCE && fabs(z.imag - checkpoint.imag) < PERIODICITY_TOLERANCE) {
+                iteration = MAX_ITERATION;
+                periodicity_resolved_pixels++;
+                break;
+            }
+
+            if (++check_steps == check_interval) {
+                checkpoint = z;
+                check_interval *= 2;
+                check_steps = 0;
+            }
+        }
+    }
+
+    // Iteration count outside the julia set, 0 inside
+    if (iteration == MAX_ITERATION) {
+        return 0;
+    }
+    return iteration;
+}
+
+void calculate_julia_array_range_mariani_silver(int width, int start_row, int end_row, int *result, double real, double imaginary) {
+
+    prepare_julia_cycle(real, imaginary);
+
+    int total_pixels = width * (end_row - start_row);
+
+    // -1 marks pixels not computed yet, -2 pixels already queued for the kernel
+    for (int i = 0; i < total_pixels; i++) {
+        result[i] = -1;
+    }
+
+    // Rectangles to examine at the current level of the subdivision and at the next one,
+    // plus the pixels the kernel computes for the current level
+    int rectangle_count = 0, rectangle_capacity = 64, next_count = 0, next_capacity = 64;
+    int pixel_count = 0, pixel_capacity = 4096;
+    Rectangle *rectangles = malloc(sizeof(Rectangle) * rectangle_capacity);
+    Rectangle *next_rectangles = malloc(sizeof(Rectangle) * next_capacity);
+    int *pixels = malloc(sizeof(int) * pixel_capacity);
+    if (!rectangles || !next_rectangles || !pixels) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // Start from the whole block of rows this rank owns
+    if (total_pixels > 0) {
+        rectangles[rectangle_count++] = (Rectangle){0, 0, width - 1, end_row - start_row - 1};
+    }
+
+    while (rectangle_count > 0) {
+
+        // Queue every pixel this level needs: the border and guard samples of each rectangle, or all
+        // of it when it is too small to split. The whole level then goes through the vector kernel
+        pixel_count = 0;
+        for (int r = 0; r < rectangle_count; r++) {
+            Rectangle rectangle = rectangles[r];
+            if (mariani_silver_is_leaf(rectangle)) {
+                for (int y = rectangle.y0; y <= rectangle.y1; y++) {
+                    for (int x = rectangle.x0; x <= rectangle.x1; x++) {
+                        mariani_silver_queue(width, result, x, y, &pixels, &pixel_count, &pixel_capacity);
+                    }
+                }
+                continue;
+            }
+            for (int x = rectangle.x0; x <= rectangle.x1; x++) {
+                mariani_silver_queue(width, result, x, rectangle.y0, &pixels, &pixel_count, &pixel_capacity);
+                mariani_silver_queue(width, result, x, rectangle.y1, &pixels, &pixel_count, &pixel_capacity);
+            }
+            for (int y = rectangle.y0 + 1; y < rectangle.y1; y++) {
+                mariani_silver_queue(width, result, rectangle.x0, y, &pixels, &pixel_count, &pixel_capacity);
+                mariani_silver_queue(width, result, rectangle.x1, y, &pixels, &pixel_count, &pixel_capacity);
+            }
+            for (int i = 0; i < MARIANI_SILVER_GUARD_SAMPLES; i++) {
+                int x, y;
+                if (mariani_silver_guard_sample(rectangle, i, &x, &y)) {
+                    mariani_silver_queue(width, result, x, y, &pixels, &pixel_count, &pixel_capacity);
+                }
+            }
+        }
+
+        if (pixel_count > 0) {
+            julia_kernel(width, start_row, end_row, result, real, imaginary, pixels, pixel_count);
+        }
+
+        // Fill rectangles whose border (and guard samples) share one value, split the rest
+        next_count = 0;
+        for (int r = 0; r < rectangle_count; r++) {
+            Rectangle rectangle = rectangles[r];
+            if (mariani_silver_is_leaf(rectangle)) {
+                continue;
+            }
+
+            int value = result[rectangle.y0 * width + rectangle.x0];
+            int uniform = 1;
+            for (int x = rectangle.x0; x <= rectangle.x1 && uniform; x++) {
+                uniform = result[rectangle.y0 * width + x] == value && result[rectangle.y1 * width + x] == value;
+            }
+            for (int y = rectangle.y0 + 1; y < rectangle.y1 && uniform; y++) {
+                uniform = result[y * width + rectangle.x0] == value && result[y * width + rectangle.x1] == value;
+            }
+
+            // Guard against detail that slips between the border pixels
+            for (int i = 0; i < MARIANI_SILVER_GUARD_SAMPLES && uniform; i++) {
+                int x, y;
+                if (mariani_silver_guard_sample(rectangle, i, &x, &y) && result[y * width + x] != value) {
+                    mariani_silver_guard_failures++;
+                    uniform = 0;
+                }
+            }
+
+            if (uniform) {
+                for (int y = rectangle.y0 + 1; y < rectangle.y1; y++) {
+                    for (int x = rectangle.x0 + 1; x < rectangle.x1; x++) {
+                        if (result[y * width + x] < 0) {
+                            result[y * width + x] = value;
+                            mariani_silver_filled_pixels++;
+                        }
+                    }
+                }
+                continue;
+            }
+
+            // Split the long sides in half; the pieces share their dividing lines
+            if (next_count + 4 > next_capacity) {
+                next_capacity *= 2;
+                next_rectangles = realloc(next_rectangles, sizeof(Rectangle) * next_capacity);
+                if (!next_rectangles) {
+                    fprintf(stderr, "Error: Memory allocation failed\n");
+                    MPI_Abort(MPI_COMM_WORLD, 1);
+                }
+            }
+            int split_x = rectangle.x1 - rectangle.x0 + 1 > MARIANI_SILVER_MIN_SIZE;
+            int split_y = rectangle.y1 - rectangle.y0 + 1 > MARIANI_SILVER_MIN_SIZE;
+            int xm = split_x ? (rectangle.x0 + rectangle.x1) / 2 : rectangle.x1;
+            int ym = split_y ? (rectangle.y0 + rectangle.y1) / 2 : rectangle.y1;
+            next_rectangles[next_count++] = (Rectangle){rectangle.x0, rectangle.y0, xm, ym};
+            if (split_x) {
+                next_rectangles[next_count++] = (Rectangle){xm, rectangle.y0, rectangle.x1, ym};
+            }
+            if (split_y) {
+                next_rectangles[next_count++] = (Rectangle){rectangle.x0, ym, xm, rectangle.y1};
+            }
+            if (split_x && split_y) {
+                next_rectangles[next_count++] = (Rectangle){xm, ym, rectangle.x1, rectangle.y1};
+            }
+        }
+
+        // Move on to the next level
+        Rectangle *swap = rectangles;
+        rectangles = next_rectangles;
+        next_rectangles = swap;
+        int swap_capacity = rectangle_capacity;
+        rectangle_capacity = next_capacity;
+        next_capacity = swap_capacity;
+        rectangle_count = next_count;
+    }
+
+    free(rectangles);
+    free(next_rectangles);
+    free(pixels);
+}
+
+void compute_reference_orbit(Fixed reference_real, Fixed reference_imag, ReferenceOrbit *reference) {
+
+    // Reference point and constant of the orbit
+    Fixed z_real = reference_real, z_imag = reference_imag;
+    Fixed c_real = fixed_from_double(REAL_NUMBER), c_imag = fixed_from_double(IMAGINARY_NUMBER);
+
+    // Iterate at full precision and keep each point rounded to double, which is all the pixels need
+    reference->length = MAX_ITERATION;
+    for (int n = 0; n <= MAX_ITERATION; n++) {
+        reference->real[n] = fixed_to_double(z_real);
+        reference->imag[n] = fixed_to_double(z_imag);
+
+        // The reference escaped, so pixels still running past this point need another reference
+        if (reference->real[n] * reference->real[n] + reference->imag[n] * reference->imag[n] > 4.0) {
+            reference->length = n;
+            break;
+        }
+
+        Fixed real_squared = fixed_mul(z_real, z_real);
+        Fixed imag_squared = fixed_mul(z_imag, z_imag);
+        Fixed cross = fixed_mul(z_real, z_imag);
+        z_real = fixed_add(fixed_sub(real_squared, imag_squared), c_real);
+        z_imag = fixed_add(fixed_add(cross, cross), c_imag);
+    }
+
+    // Without a series approximation every pixel starts at iteration 0
+    reference->skip = 0;
+    reference->series[0] = (Complex){.real = 1.0, .imag = 0.0};
+    reference->series[1] = reference->series[2] = (Complex){.real = 0.0, .imag = 0.0};
+}
+
+void series_coefficients(const ReferenceOrbit *reference, int iterations, Complex *coefficients) {
+
+    // d_n = A d + B d^2 + C d^3 approximates the delta after n iterations, where d is the pixel's
+    // offset from the reference. Substituting into d' = 2 Z d + d^2 gives
+    // A' = 2 Z A, B' = 2 Z B + A^2, C' = 2 Z C + 2 A B
+    Complex a = {.real = 1.0, .imag = 0.0}, b = {0.0, 0.0}, c = {0.0, 0.0};
+    for (int n = 0; n < iterations; n++) {
+        Complex two_z = {.real = 2.0 * reference->real[n], .imag = 2.0 * reference->imag[n]};
+        Complex next_c = complex_add(complex_mul(two_z, c), complex_mul((Complex){2.0 * a.real, 2.0 * a.imag}, b));
+        Complex next_b = complex_add(complex_mul(two_z, b), complex_mul(a, a));
+        a = complex_mul(two_z, a);
+        b = next_b;
+        c = next_c;
+    }
+    coefficients[0] = a;
+    coefficients[1] = b;
+    coefficients[2] = c;
+}
+
+int series_matches_probes(const ReferenceOrbit *reference, int iterations, const Complex *coefficients, double half_width, double half_height) {
+
+    // Iterate the corners of the view without the series and compare
+    double corners[4][2] = {{-half_width, -half_height}, {half_width, -half_height}, {-half_width, half_height}, {half_width, half_height}};
+    for (int corner = 0; corner < 4; corner++) {
+        Complex offset = {.real = corners[corner][0], .imag = corners[corner][1]};
+        double delta_real = offset.real, delta_imag = offset.imag;
+        for (int n = 0; n < iterations; n++) {
+            double z_real = reference->real[n], z_imag = reference->imag[n];
+
+            // A corner that escapes before the skip would be given the wrong count
+            double full_real = z_real + delta_real, full_imag = z_imag + delta_imag;
+            if (full_real * full_real + full_imag * full_imag > 4.0) {
+                return 0;
+            }
+
+            double temp = 2.0 * (z_real * delta_real - z_imag * delta_imag) + delta_real * delta_real - delta_imag * delta_imag;
+            delta_imag = 2.0 * (z_real * delta_imag + z_imag * delta_real) + 2.0 * delta_real * delta_imag;
+            delta_real = temp;
+        }
+
+        Complex approximation = series_delta(coefficients, offset);
+        double error = complex_abs((Complex){.real = approximation.real - delta_real, .imag = approximation.imag - delta_imag});
+        if (!(error <= DEEP_ZOOM_SERIES_TOLERANCE * complex_abs((Complex){.real = delta_real, .imag = delta_imag}))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void compute_series_approximation(ReferenceOrbit *reference, double half_width, double half_height) {
+
+    double radius = sqrt(half_width * half_width + half_height * half_height);
+
+    // Go on while the cubic term stays negligible next to the linear one over the whole view
+    Complex coefficients[3];
+    int skip = 0;
+    Complex a = {.real = 1.0, .imag = 0.0}, b = {0.0, 0.0}, c = {0.0, 0.0};
+    for (int n = 0; n < reference->length; n++) {
+        Complex two_z = {.real = 2.0 * reference->real[n], .imag = 2.0 * reference->imag[n]};
+        Complex next_c = complex_add(complex_mul(two_z, c), complex_mul((Complex){2.0 * a.real, 2.0 * a.imag}, b));
+        Complex next_b = complex_add(complex_mul(two_z, b), complex_mul(a, a));
+        Complex next_a = complex_mul(two_z, a);
+        if (!(complex_abs(next_c) * radius * radius <= DEEP_ZOOM_SERIES_TOLERANCE * complex_abs(next_a))) {
+            break;
+        }
+        a = next_a;
+        b = next_b;
+        c = next_c;
+        skip = n + 1;
+    }
+
+    // The corners of the view have the last word; back off until they agree
+    series_coefficients(reference, skip, coefficients);
+    while (skip > 0 && !series_matches_probes(reference, skip, coefficients, half_width, half_height)) {
+        skip /= 2;
+        series_coefficients(reference, skip, coefficients);
+    }
+
+    reference->skip = skip;
+    for (int i = 0; i < 3; i++) {
+        reference->series[i] = coefficients[i];
+    }
+}
+
+int julia_perturbation_value(const ReferenceOrbit *reference, int start, double delta_real, double delta_imag, int *glitched) {
+
+    for (int n = start; n < MAX_ITERATION; n++) {
+
+        // Full value of the pixel's orbit
+        double z_real = reference->real[n] + delta_real;
+        double z_imag = reference->imag[n] + delta_imag;
+        double magnitude = z_real * z_real + z_imag * z_imag;
+        if (magnitude > 4.0) {
+            return n;
+        }
+
+        // The orbit came much closer to 0 than the reference, so the delta has lost its precision
+        // (or the reference escaped before the pixel did). Leave the pixel for another reference
+        double reference_magnitude = reference->real[n] * reference->real[n] + reference->imag[n] * reference->imag[n];
+        if (magnitude < DEEP_ZOOM_GLITCH_TOLERANCE * DEEP_ZOOM_GLITCH_TOLERANCE * reference_magnitude || n == reference->length) {
+            *glitched = 1;
+            return 0;
+        }
+
+        // d' = 2 Z d + d^2
+        double temp = 2.0 * (reference->real[n] * delta_real - reference->imag[n] * delta_imag) + delta_real * delta_real - delta_imag * delta_imag;
+        delta_imag = 2.0 * (reference->real[n] * delta_imag + reference->imag[n] * delta_real) + 2.0 * delta_real * delta_imag;
+        delta_real = temp;
+    }
+
+    // Inside the julia set
+    return 0;
+}
+
+void calculate_julia_array_range_perturbation(int width, int start_row, int end_row, int *result, const ReferenceOrbit *reference) {
+
+    // Square pixels around the centre; offsets from the centre are small enough for doubles
+    double spacing = 2.0 * DEEP_ZOOM_RADIUS / HEIGHT;
+    int total_pixels = width * (end_row - start_row);
+
+    // Pixels that glitched against the current reference
+    int glitched_count = 0;
+    int *glitched_pixels = malloc(sizeof(int) * (total_pixels > 0 ? total_pixels : 1));
+    if (!glitched_pixels) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    for (int pixel = 0; pixel < total_pixels; pixel++) {
+        Complex offset = {.real = (pixel % width - width / 2.0) * spacing, .imag = (start_row + pixel / width - HEIGHT / 2.0) * spacing};
+
+        // Jump straight to iteration skip with the series approximation (the series is exact at skip 0)
+        Complex delta = series_delta(reference->series, offset);
+
+        int glitched = 0;
+        result[pixel] = julia_perturbation_value(reference, reference->skip, delta.real, delta.imag, &glitched);
+        if (glitched) {
+            glitched_pixels[glitched_count++] = pixel;
+        }
+    }
+
+    // Re-reference: take a glitched pixel as the new reference point and redo the glitched pixels
+    // relative to it, until none are left or DEEP_ZOOM_MAX_REFERENCES is reached
+    ReferenceOrbit local = {.real = malloc(sizeof(double) * (MAX_ITERATION + 1)), .imag = malloc(sizeof(double) * (MAX_ITERATION + 1))};
+    if (!local.real || !local.imag) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    Fixed centre_real = fixed_from_string(DEEP_ZOOM_CENTER_REAL);
+    Fixed centre_imag = fixed_from_string(DEEP_ZOOM_CENTER_IMAG);
+
+    for (int references = 1; glitched_count > 0 && references < DEEP_ZOOM_MAX_REFERENCES; references++) {
+
+        int chosen = glitched_pixels[glitched_count / 2];
+        Complex chosen_offset = {.real = (chosen % width - width / 2.0) * spacing, .imag = (start_row + chosen / width - HEIGHT / 2.0) * spacing};
+        compute_reference_orbit(fixed_add(centre_real, fixed_from_double(chosen_offset.real)), fixed_add(centre_imag, fixed_from_double(chosen_offset.imag)), &local);
+        deep_zoom_extra_references++;
+
+        int still_glitched = 0;
+        for (int i = 0; i < glitched_count; i++) {
+            int pixel = glitched_pixels[i];
+            Complex offset = {.real = (pixel % width - width / 2.0) * spacing - chosen_offset.real, .imag = (start_row + pixel / width - HEIGHT / 2.0) * spacing - chosen_offset.imag};
+
+            int glitched = 0;
+            result[pixel] = julia_perturbation_value(&local, 0, offset.real, offset.imag, &glitched);
+            if (glitched) {
+                glitched_pixels[still_glitched++] = pixel;
+            }
+        }
+        glitched_count = still_glitched;
+    }
+
+    // Whatever is left keeps the value 0 (inside)
+    deep_zoom_unresolved_glitches += glitched_count;
+
+    free(local.real);
+    free(local.imag);
+    free(glitched_pixels);
+}
+
+KERNEL_INLINE
+int next_julia_pixel(int width, int start_row, const int *pixels, int total_pixels, int *next_pixel, double *z_real, double *z_imag) {
+
+    // Range used up
+    if (*next_pixel >= total_pixels) {
+        return -1;
+    }
+
+    // Same mapping from pixel to complex plane as calculate_julia_array_range_scalar
+    int pixel = pixels ? pixels[*next_pixel] : *next_pixel;
+    (*next_pixel)++;
+    *z_real = (pixel % width) / (double)width * (VIEW_XMAX - VIEW_XMIN) + VIEW_XMIN;
+    *z_imag = (start_row + pixel / width) / (double)HEIGHT * (VIEW_YMAX - VIEW_YMIN) + VIEW_YMIN;
+    return pixel;
+}
+
+#ifdef X86_KERNELS
+// SSE2 version of calculate_julia_array_range_avx2, iterating 2 pixels at a time.
+__attribute__((target("sse2")))
+void calculate_julia_array_range_sse2(int width, int start_row, int end_row, int *result, double real, double imaginary, const int *pixels, int pixel_count) {
+
+    // Either the listed pixels of the block or all of it
+    int total_pixels = pixels ? pixel_count : width * (end_row - start_row);
+    int next_pixel = 0;
+
+    // Per-lane state, spilled to memory only when a lane has to be refilled
+    double lane_real[2], lane_imag[2], lane_iteration[2];
+    double lane_check_real[2], lane_check_imag[2], lane_check_interval[2], lane_check_steps[2];
+    int lane_pixel[2];
+    int live_lanes = 0; // Bit i is set while lane i holds a pixel
+
+    for (int lane = 0; lane < 2; lane++) {
+        lane_real[lane] = lane_imag[lane] = lane_iteration[lane] = 0.0;
+        lane_pixel[lane] = next_julia_pixel(width, start_row, pixels, total_pixels, &next_pixel, &lane_real[lane], &lane_imag[lane]);
+        if (lane_pixel[lane] >= 0) {
+            live_lanes |= 1 << lane;
+        }
+        lane_check_real[lane] = lane_real[lane];
+        lane_check_imag[lane] = lane_imag[lane];
+        lane_check_interval[lane] = 1.0;
+        lane_check_steps[lane] = 0.0;
+    }
+
+    __m128d z_real = _mm_loadu_pd(lane_real);
+    __m128d z_imag = _mm_loadu_pd(lane_imag);
+    __m128d iteration = _mm_loadu_pd(lane_iteration);
+    __m128d check_real = _mm_loadu_pd(lane_check_real);
+    __m128d check_imag = _mm_loadu_pd(lane_check_imag);
+    __m128d check_interval = _mm_loadu_pd(lane_check_interval);
+    __m128d check_steps = _mm_loadu_pd(lane_check_steps);
+
+    const __m128d c_real = _mm_set1_pd(real);
+    const __m128d c_imag = _mm_set1_pd(imaginary);
+    const __m128d four = _mm_set1_pd(4.0);
+    const __m128d two = _mm_set1_pd(2.0);
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d max_iteration = _mm_set1_pd(MAX_ITERATION);
+
+    // Disc around the attracting cycle, see find_attracting_cycle
+    const int use_trap = ATTRACTING_CYCLE_TRAP && julia_cycle.found;
+    const __m128d trap_real = _mm_set1_pd(julia_cycle.point.real);
+    const __m128d trap_imag = _mm_set1_pd(julia_cycle.point.imag);
+    const __m128d trap_radius_squared = _mm_set1_pd(julia_cycle.radius * julia_cycle.radius);
+
+    const __m128d tolerance = _mm_set1_pd(PERIODICITY_TOLERANCE);
+    const __m128d sign_bit = _mm_set1_pd(-0.0);
+
+    while (live_lanes) {
+
+        // Lanes still inside the escape radius and below the iteration limit
+        __m128d real_squared = _mm_mul_pd(z_real, z_real);
+        __m128d imag_squared = _mm_mul_pd(z_imag, z_imag);
+        __m128d magnitude = _mm_add_pd(real_squared, imag_squared);
+        __m128d running = _mm_and_pd(_mm_cmple_pd(magnitude, four),
+                                     _mm_cmplt_pd(iteration, max_iteration));
+
+        int finished_lanes = ~_mm_movemask_pd(running) & live_lanes;
+
+        if (finished_lanes) {
+
+            // Store finished pixels and load the next pixels into their lanes
+            _mm_storeu_pd(lane_real, z_real);
+            _mm_storeu_pd(lane_imag, z_imag);
+            _mm_storeu_pd(lane_iteration, iteration);
+            _mm_storeu_pd(lane_check_real, check_real);
+            _mm_storeu_pd(lane_check_imag, check_imag);
+            _mm_storeu_pd(lane_check_interval, check_interval);
+            _mm_storeu_pd(lane_check_steps, check_steps);
+
+            for (int lane = 0; lane < 2; lane++) {
+                if (!(finished_lanes & (1 << lane))) {
+                    continue;
+                }
+
+                int count = (int)lane_iteration[lane];
+                result[lane_pixel[lane]] = (count == MAX_ITERATION) ? 0 : count;
+
+                lane_pixel[lane] = next_julia_pixel(width, start_row, pixels, total_pixels, &next_pixel, &lane_real[lane], &lane_imag[lane]);
+                lane_iteration[lane] = 0.0;
+                lane_check_real[lane] = lane_real[lane];
+                lane_check_imag[lane] = lane_imag[lane];
+                lane_check_interval[lane] = 1.0;
+                lane_check_steps[lane] = 0.0;
+                if (lane_pixel[lane] < 0) {
+                    // Nothing left to hand out, park the lane
+                    lane_real[lane] = lane_imag[lane] = 0.0;
+                    live_lanes &= ~(1 << lane);
+                }
+            }
+
+            z_real = _mm_loadu_pd(lane_real);
+            z_imag = _mm_loadu_pd(lane_imag);
+            iteration = _mm_loadu_pd(lane_iteration);
+            check_real = _mm_loadu_pd(lane_check_real);
+            check_imag = _mm_loadu_pd(lane_check_imag);
+            check_interval = _mm_loadu_pd(lane_check_interval);
+            check_steps = _mm_loadu_pd(lane_check_steps);
+
+            // Refilled lanes must pass the escape test before their first iteration
+            continue;
+        }
+
+        // z = z^2 + c on every lane
+        __m128d temp = _mm_add_pd(_mm_sub_pd(real_squared, imag_squared), c_real);
+        z_imag = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(two, z_real), z_imag), c_imag);
+        z_real = temp;
+        iteration = _mm_add_pd(iteration, one);
+
+        int trapped_lanes = 0;
+        if (use_trap) {
+
+            // Lanes whose orbit reached the attracting cycle stay on it and never escape
+            __m128d trap_distance_real = _mm_sub_pd(z_real, trap_real);
+            __m128d trap_distance_imag = _mm_sub_pd(z_imag, trap_imag);
+            __m128d trapped = _mm_cmplt_pd(_mm_add_pd(_mm_mul_pd(trap_distance_real, trap_distance_real), _mm_mul_pd(trap_distance_imag, trap_distance_imag)), trap_radius_squared);
+            trapped_lanes = _mm_movemask_pd(trapped) & live_lanes;
+            trap_resolved_pixels += __builtin_popcount(trapped_lanes);
+            iteration = _mm_or_pd(_mm_and_pd(trapped, max_iteration), _mm_andnot_pd(trapped, iteration));
+        }
+
+        if (PERIODICITY_CHECK) {
+
+            // Lanes whose orbit came back to the checkpoint are caught in a cycle and never escape
+            __m128d periodic = _mm_and_pd(_mm_cmplt_pd(_mm_andnot_pd(sign_bit, _mm_sub_pd(z_real, check_real)), tolerance),
+                                          _mm_cmplt_pd(_mm_andnot_pd(sign_bit, _mm_sub_pd(z_imag, check_imag)), tolerance));
+            // (lanes the trap already resolved are not counted twice)
+            periodicity_resolved_pixels += __builtin_popcount(_mm_movemask_pd(periodic) & live_lanes & ~trapped_lanes);
+            iteration = _mm_or_pd(_mm_and_pd(periodic, max_iteration), _mm_andnot_pd(periodic, iteration));
+
+            // Move the checkpoint to the current point after 1, 2, 4, 8... iterations
+            check_steps = _mm_add_pd(check_steps, one);
+            __m128d move_checkpoint = _mm_cmpeq_pd(check_steps, check_interval);
+            check_real = _mm_or_pd(_mm_and_pd(move_checkpoint, z_real), _mm_andnot_pd(move_checkpoint, check_real));
+            check_imag = _mm_or_pd(_mm_and_pd(move_checkpoint, z_imag), _mm_andnot_pd(move_checkpoint, check_imag));
+            check_interval = _mm_or_pd(_mm_and_pd(move_checkpoint, _mm_add_pd(check_interval, check_interval)), _mm_andnot_pd(move_checkpoint, check_interval));
+            check_steps = _mm_or_pd(_mm_and_pd(move_checkpoint, _mm_setzero_pd()), _mm_andnot_pd(move_checkpoint, check_steps));
+        }
+    }
+}
+
+// Iterates 4 pixels at a time, one per 64-bit lane. When a lane escapes (or reaches
+// MAX_ITERATION) its result is stored and the lane is refilled with the next pixel
+// of the range, so one slow pixel never holds the other lanes idle.
+// Uses the same operation order as the scalar loop, so iteration counts are identical.
+__attribute__((target("avx2")))
+void calculate_julia_array_range_avx2(int width, int start_row, int end_row, int *result, double real, double imaginary, const int *pixels, int pixel_count) {
+
+    // Either the listed pixels of the block or all of it
+    int total_pixels = pixels ? pixel_count : width * (end_row - start_row);
+    int next_pixel = 0;
+
+    // Per-lane state, spilled to memory only when a lane has to be refilled
+    double lane_real[4], lane_imag[4], lane_iteration[4];
+    double lane_check_real[4], lane_check_imag[4], lane_check_interval[4], lane_check_steps[4];
+    int lane_pixel[4];
+    int live_lanes = 0; // Bit i is set while lane i holds a pixel
+
+    for (int lane = 0; lane < 4; lane++) {
+        lane_real[lane] = lane_imag[lane] = lane_iteration[lane] = 0.0;
+        lane_pixel[lane] = next_julia_pixel(width, start_row, pixels, total_pixels, &next_pixel, &lane_real[lane], &lane_imag[lane]);
+        if (lane_pixel[lane] >= 0) {
+            live_lanes |= 1 << lane;
+        }
+        lane_check_real[lane] = lane_real[lane];
+        lane_check_imag[lane] = lane_imag[lane];
+        lane_check_interval[lane] = 1.0;
+        lane_check_steps[lane] = 0.0;
+    }
+
+    __m256d z_real = _mm256_loadu_pd(lane_real);
+    __m256d z_imag = _mm256_loadu_pd(lane_imag);
+    __m256d iteration = _mm256_loadu_pd(lane_iteration);
+    __m256d check_real = _mm256_loadu_pd(lane_check_real);
+    __m256d check_imag = _mm256_loadu_pd(lane_check_imag);
+    __m256d check_interval = _mm256_loadu_pd(lane_check_interval);
+    __m256d check_steps = _mm256_loadu_pd(lane_check_steps);
+
+    const __m256d c_real = _mm256_set1_pd(real);
+    const __m256d c_imag = _mm256_set1_pd(imaginary);
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d max_iteration = _mm256_set1_pd(MAX_ITERATION);
+
+    // Disc around the attracting cycle, see find_attracting_cycle
+    const int use_trap = ATTRACTING_CYCLE_TRAP && julia_cycle.found;
+    const __m256d trap_real = _mm256_set1_pd(julia_cycle.point.real);
+    const __m256d trap_imag = _mm256_set1_pd(julia_cycle.point.imag);
+    const __m256d trap_radius_squared = _mm256_set1_pd(julia_cycle.radius * julia_cycle.radius);
+
+    const __m256d tolerance = _mm256_set1_pd(PERIODICITY_TOLERANCE);
+    const __m256d sign_bit = _mm256_set1_pd(-0.0);
+
+    while (live_lanes) {
+
+        // Lanes still inside the escape radius and below the iteration limit
+        __m256d real_squared = _mm256_mul_pd(z_real, z_real);
+        __m256d imag_squared = _mm256_mul_pd(z_imag, z_imag);
+        __m256d magnitude = _mm256_add_pd(real_squared, imag_squared);
+        __m256d running = _mm256_and_pd(_mm256_cmp_pd(magnitude, four, _CMP_LE_OQ),
+                                        _mm256_cmp_pd(iteration, max_iteration, _CMP_LT_OQ));
+
+        int finished_lanes = ~_mm256_movemask_pd(running) & live_lanes;
+
+        if (finished_lanes) {
+
+            // Store finished pixels and load the next pixels into their lanes
+            _mm256_storeu_pd(lane_real, z_real);
+            _mm256_storeu_pd(lane_imag, z_imag);
+            _mm256_storeu_pd(lane_iteration, iteration);
+            _mm256_storeu_pd(lane_check_real, check_real);
+            _mm256_storeu_pd(lane_check_imag, check_imag);
+            _mm256_storeu_pd(lane_check_interval, check_interval);
+            _mm256_storeu_pd(lane_check_steps, check_steps);
+
+            for (int lane = 0; lane < 4; lane++) {
+                if (!(finished_lanes & (1 << lane))) {
+                    continue;
+                }
+
+                int count = (int)lane_iteration[lane];
+                result[lane_pixel[lane]] = (count == MAX_ITERATION) ? 0 : count;
+
+                lane_pixel[lane] = next_julia_pixel(width, start_row, pixels, total_pixels, &next_pixel, &lane_real[lane], &lane_imag[lane]);
+                lane_iteration[lane] = 0.0;
+                lane_check_real[lane] = lane_real[lane];
+                lane_check_imag[lane] = lane_imag[lane];
+                lane_check_interval[lane] = 1.0;
+                lane_check_steps[lane] = 0.0;
+                if (lane_pixel[lane] < 0) {
+                    // Nothing left to hand out, park the lane
+                    lane_real[lane] = lane_imag[lane] = 0.0;
+                    live_lanes &= ~(1 << lane);
+                }
+            }
+
+            z_real = _mm256_loadu_pd(lane_real);
+            z_imag = _mm256_loadu_pd(lane_imag);
+            iteration = _mm256_loadu_pd(lane_iteration);
+            check_real = _mm256_loadu_pd(lane_check_real);
+            check_imag = _mm256_loadu_pd(lane_check_imag);
+            check_interval = _mm256_loadu_pd(lane_check_interval);
+            check_steps = _mm256_loadu_pd(lane_check_steps);
+
+            // Refilled lanes must pass the escape test before their first iteration
+            continue;
+        }
+
+        // z = z^2 + c on every lane
+        __m256d temp = _mm256_add_pd(_mm256_sub_pd(real_squared, imag_squared), c_real);
+        z_imag = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(two, z_real), z_imag), c_imag);
+        z_real = temp;
+        iteration = _mm256_add_pd(iteration, one);
+
+        int trapped_lanes = 0;
+        if (use_trap) {
+
+            // Lanes whose orbit reached the attracting cycle stay on it and never escape
+            __m256d trap_distance_real = _mm256_sub_pd(z_real, trap_real);
+            __m256d trap_distance_imag = _mm256_sub_pd(z_imag, trap_imag);
+            __m256d trapped = _mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(trap_distance_real, trap_distance_real), _mm256_mul_pd(trap_distance_imag, trap_distance_imag)), trap_radius_squared, _CMP_LT_OQ);
+            trapped_lanes = _mm256_movemask_pd(trapped) & live_lanes;
+            trap_resolved_pixels += __builtin_popcount(trapped_lanes);
+            iteration = _mm256_blendv_pd(iteration, max_iteration, trapped);
+        }
+
+        if (PERIODICITY_CHECK) {
+
+            // Lanes whose orbit came back to the checkpoint are caught in a cycle and never escape
+            __m256d periodic = _mm256_and_pd(_mm256_cmp_pd(_mm256_andnot_pd(sign_bit, _mm256_sub_pd(z_real, check_real)), tolerance, _CMP_LT_OQ),
+                                             _mm256_cmp_pd(_mm256_andnot_pd(sign_bit, _mm256_sub_pd(z_imag, check_imag)), tolerance, _CMP_LT_OQ));
+            // (lanes the trap already resolved are not counted twice)
+            periodicity_resolved_pixels += __builtin_popcount(_mm256_movemask_pd(periodic) & live_lanes & ~trapped_lanes);
+            iteration = _mm256_blendv_pd(iteration, max_iteration, periodic);
+
+            // Move the checkpoint to the current point after 1, 2, 4, 8... iterations
+            check_steps = _mm256_add_pd(check_steps, one);
+            __m256d move_checkpoint = _mm256_cmp_pd(check_steps, check_interval, _CMP_EQ_OQ);
+            check_real = _mm256_blendv_pd(check_real, z_real, move_checkpoint);
+            check_imag = _mm256_blendv_pd(check_imag, z_imag, move_checkpoint);
+            check_interval = _mm256_blendv_pd(check_interval, _mm256_add_pd(check_interval, check_interval), move_checkpoint);
+            check_steps = _mm256_blendv_pd(check_steps, _mm256_setzero_pd(), move_checkpoint);
+        }
+    }
+}
+
+// AVX-512 version of calculate_julia_array_range_avx2, iterating 8 pixels at a time.
+__attribute__((target("avx512f")))
+void calculate_julia_array_range_avx512(int width, int start_row, int end_row, int *result, double real, double imaginary, const int *pixels, int pixel_count) {
+
+    // Either the listed pixels of the block or all of it
+    int total_pixels = pixels ? pixel_count : width * (end_row - start_row);
+    int next_pixel = 0;
+
+    // Per-lane state, spilled to memory only when a lane has to be refilled
+    double lane_real[8], lane_imag[8], lane_iteration[8];
+    double lane_check_real[8], lane_check_imag[8], lane_check_interval[8], lane_check_steps[8];
+    int lane_pixel[8];
+    int live_lanes = 0; // Bit i is set while lane i holds a pixel
+
+    for (int lane = 0; lane < 8; lane++) {
+        lane_real[lane] = lane_imag[lane] = lane_iteration[lane] = 0.0;
+        lane_pixel[lane] = next_julia_pixel(width, start_row, pixels, total_pixels, &next_pixel, &lane_real[lane], &lane_imag[lane]);
+        if (lane_pixel[lane] >= 0) {
+            live_lanes |= 1 << lane;
+        }
+        lane_check_real[lane] = lane_real[lane];
+        lane_check_imag[lane] = lane_imag[lane];
+        lane_check_interval[lane] = 1.0;
+        lane_check_steps[lane] = 0.0;
+    }
+
+    __m512d z_real = _mm512_loadu_pd(lane_real);
+    __m512d z_imag = _mm512_loadu_pd(lane_imag);
+    __m512d iteration = _mm512_loadu_pd(lane_iteration);
+    __m512d check_real = _mm512_loadu_pd(lane_check_real);
+    __m512d check_imag = _mm512_loadu_pd(lane_check_imag);
+    __m512d check_interval = _mm512_loadu_pd(lane_check_interval);
+    __m512d check_steps = _mm512_loadu_pd(lane_check_steps);
+
+    const __m512d c_real = _mm512_set1_pd(real);
+    const __m512d c_imag = _mm512_set1_pd(imaginary);
+    const __m512d four = _mm512_set1_pd(4.0);
+    const __m512d two = _mm512_set1_pd(2.0);
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d max_iteration = _mm512_set1_pd(MAX_ITERATION);
+
+    // Disc around the attracting cycle, see find_attracting_cycle
+    const int use_trap = ATTRACTING_CYCLE_TRAP && julia_cycle.found;
+    const __m512d trap_real = _mm512_set1_pd(julia_cycle.point.real);
+    const __m512d trap_imag = _mm512_set1_pd(julia_cycle.point.imag);
+    const __m512d trap_radius_squared = _mm512_set1_pd(julia_cycle.radius * julia_cycle.radius);
+
+    const __m512d tolerance = _mm512_set1_pd(PERIODICITY_TOLERANCE);
+
+    while (live_lanes) {
+
+        // Lanes still inside the escape radius and below the iteration limit
+        __m512d real_squared = _mm512_mul_pd(z_real, z_real);
+        __m512d imag_squared = _mm512_mul_pd(z_imag, z_imag);
+        __m512d magnitude = _mm512_add_pd(real_squared, imag_squared);
+        __mmask8 running = _mm512_cmp_pd_mask(magnitude, four, _CMP_LE_OQ)
+                         & _mm512_cmp_pd_mask(iteration, max_iteration, _CMP_LT_OQ);
+
+        int finished_lanes = ~(int)running & live_lanes;
+
+        if (finished_lanes) {
+
+            // Store finished pixels and load the next pixels into their lanes
+            _mm512_storeu_pd(lane_real, z_real);
+            _mm512_storeu_pd(lane_imag, z_imag);
+            _mm512_storeu_pd(lane_iteration, iteration);
+            _mm512_storeu_pd(lane_check_real, check_real);
+            _mm512_storeu_pd(lane_check_imag, check_imag);
+            _mm512_storeu_pd(lane_check_interval, check_interval);
+            _mm512_storeu_pd(lane_check_steps, check_steps);
+
+            for (int lane = 0; lane < 8; lane++) {
+                if (!(finished_lanes & (1 << lane))) {
+                    continue;
+                }
+
+                int count = (int)lane_iteration[lane];
+                result[lane_pixel[lane]] = (count == MAX_ITERATION) ? 0 : count;
+
+                lane_pixel[lane] = next_julia_pixel(width, start_row, pixels, total_pixels, &next_pixel, &lane_real[lane], &lane_imag[lane]);
+                lane_iteration[lane] = 0.0;
+                lane_check_real[lane] = lane_real[lane];
+                lane_check_imag[lane] = lane_imag[lane];
+                lane_check_interval[lane] = 1.0;
+                lane_check_steps[lane] = 0.0;
+                if (lane_pixel[lane] < 0) {
+                    // Nothing left to hand out, park the lane
+                    lane_real[lane] = lane_imag[lane] = 0.0;
+                    live_lanes &= ~(1 << lane);
+                }
+            }
+
+            z_real = _mm512_loadu_pd(lane_real);
+            z_imag = _mm512_loadu_pd(lane_imag);
+            iteration = _mm512_loadu_pd(lane_iteration);
+            check_real = _mm512_loadu_pd(lane_check_real);
+            check_imag = _mm512_loadu_pd(lane_check_imag);
+            check_interval = _mm512_loadu_pd(lane_check_interval);
+            check_steps = _mm512_loadu_pd(lane_check_steps);
+
+            // Refilled lanes must pass the escape test before their first iteration
+            continue;
+        }
+
+        // z = z^2 + c on every lane
+        __m512d temp = _mm512_add_pd(_mm512_sub_pd(real_squared, imag_squared), c_real);
+        z_imag = _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(two, z_real), z_imag), c_imag);
+        z_real = temp;
+        iteration = _mm512_add_pd(iteration, one);
+
+        int trapped_lanes = 0;
+        if (use_trap) {
+
+            // Lanes whose orbit reached the attracting cycle stay on it and never escape
+            __m512d trap_distance_real = _mm512_sub_pd(z_real, trap_real);
+            __m512d trap_distance_imag = _mm512_sub_pd(z_imag, trap_imag);
+            __mmask8 trapped = _mm512_cmp_pd_mask(_mm512_add_pd(_mm512_mul_pd(trap_distance_real, trap_distance_real), _mm512_mul_pd(trap_distance_imag, trap_distance_imag)), trap_radius_squared, _CMP_LT_OQ);
+            trapped_lanes = (int)trapped & live_lanes;
+            trap_resolved_pixels += __builtin_popcount(trapped_lanes);
+            iteration = _mm512_mask_blend_pd(trapped, iteration, max_iteration);
+        }
+
+        if (PERIODICITY_CHECK) {
+
+            // Lanes whose orbit came back to the checkpoint are caught in a cycle and never escape
+            __mmask8 periodic = _mm512_cmp_pd_mask(_mm512_abs_pd(_mm512_sub_pd(z_real, check_real)), tolerance, _CMP_LT_OQ)
+                              & _mm512_cmp_pd_mask(_mm512_abs_pd(_mm512_sub_pd(z_imag, check_imag)), tolerance, _CMP_LT_OQ);
+            // (lanes the trap already resolved are not counted twice)
+            periodicity_resolved_pixels += __builtin_popcount((int)periodic & live_lanes & ~trapped_lanes);
+            iteration = _mm512_mask_blend_pd(periodic, iteration, max_iteration);
+
+            // Move the checkpoint to the current point after 1, 2, 4, 8... iterations
+            check_steps = _mm512_add_pd(check_steps, one);
+            __mmask8 move_checkpoint = _mm512_cmp_pd_mask(check_steps, check_interval, _CMP_EQ_OQ);
+            check_real = _mm512_mask_blend_pd(move_checkpoint, check_real, z_real);
+            check_imag = _mm512_mask_blend_pd(move_checkpoint, check_imag, z_imag);
+            check_interval = _mm512_mask_blend_pd(move_checkpoint, check_interval, _mm512_add_pd(check_interval, check_interval));
+            check_steps = _mm512_mask_blend_pd(move_checkpoint, check_steps, _mm512_setzero_pd());
+        }
+    }
+}
+#endif
+
+#ifdef DOUBLE_DOUBLE_KERNELS
+// Double-double version of calculate_julia_array_range_scalar, iterating
+// DOUBLE_DOUBLE_LANES pixels at a time. Like the AVX2 and AVX-512 kernels, a lane that finishes
+// takes the next pixel of the range, so each lane keeps its own iteration count and periodicity
+// checkpoint. Escape, trap and periodicity tests only need the hi parts
+KERNEL_INLINE
+void julia_double_double_lanes(int width, int start_row, int end_row, int *result, double real, double imaginary, const int *pixels, int pixel_count) {
+
+    // Either the listed pixels of the block or all of it
+    int total_pixels = pixels ? pixel_count : width * (end_row - start_row);
+    int next_pixel = 0;
+
+    const DoubleLanes zero = {0};
+    const DoubleLanes one = zero + 1.0;
+    const DoubleLanes max_iteration = zero + MAX_ITERATION;
+
+    // Lanes are read and set through arrays copied in whole, as indexing a vector lane by lane
+    // makes GCC split it into scalars. Every lane starts empty and takes a pixel on the first pass
+    int lane_pixel[DOUBLE_DOUBLE_LANES];
+    double lane_x[DOUBLE_DOUBLE_LANES], lane_y[DOUBLE_DOUBLE_LANES], lane_iteration[DOUBLE_DOUBLE_LANES];
+    long long lane_done[DOUBLE_DOUBLE_LANES], lane_periodic[DOUBLE_DOUBLE_LANES];
+    long long lane_trapped[DOUBLE_DOUBLE_LANES], lane_parked[DOUBLE_DOUBLE_LANES];
+    for (int lane = 0; lane < DOUBLE_DOUBLE_LANES; lane++) {
+        lane_pixel[lane] = -1;
+        lane_x[lane] = lane_y[lane] = 0;
+        lane_parked[lane] = 0;
+    }
+
+    DoubleDoubleLanes z_real = {{0}, {0}}, z_imag = {{0}, {0}};
+    DoubleDoubleLanes c_real = {.hi = zero + real, .lo = {0}};
+    DoubleDoubleLanes c_imag = {.hi = zero + imaginary, .lo = {0}};
+    DoubleLanes iteration = zero, check_real = zero, check_imag = zero, check_interval = one, check_steps = zero;
+    LaneMask periodic_lanes = {0}, trapped_lanes = {0}, parked = {0}, done = ~parked;
+
+    while (1) {
+
+        // Lanes still inside the escape radius that no check has finished. A second comparison
+        // in this mask makes GCC split it into scalars, so the iteration limit is applied apart
+        LaneMask running = (z_real.hi * z_real.hi + z_imag.hi * z_imag.hi <= 4.0) & ~(periodic_lanes | trapped_lanes | parked);
+        running &= iteration < max_iteration;
+        done = ~running & ~parked;
+
+        if (lanes_any(&done)) {
+
+            // Iteration count outside the julia set, 0 inside. Each finished lane then takes
+            // the next pixel, or is parked once the range is used up
+            memcpy(lane_done, &done, sizeof(lane_done));
+            memcpy(lane_iteration, &iteration, sizeof(lane_iteration));
+            memcpy(lane_periodic, &periodic_lanes, sizeof(lane_periodic));
+            memcpy(lane_trapped, &trapped_lanes, sizeof(lane_trapped));
+            for (int lane = 0; lane < DOUBLE_DOUBLE_LANES; lane++) {
+                if (!lane_done[lane]) {
+                    continue;
+                }
+                if (lane_pixel[lane] >= 0) {
+                    int count = (int)lane_iteration[lane];
+                    result[lane_pixel[lane]] = (lane_periodic[lane] || lane_trapped[lane] || count == MAX_ITERATION) ? 0 : count;
+                    periodicity_resolved_pixels += lane_periodic[lane] != 0;
+                    trap_resolved_pixels += lane_trapped[lane] != 0;
+                }
+                if (next_pixel < total_pixels) {
+                    lane_pixel[lane] = pixels ? pixels[next_pixel] : next_pixel;
+                    lane_x[lane] = lane_pixel[lane] % width;
+                    lane_y[lane] = start_row + lane_pixel[lane] / width;
+                    next_pixel++;
+                } else {
+                    lane_pixel[lane] = -1;
+                    lane_parked[lane] = -1;
+                }
+            }
+            memcpy(&parked, lane_parked, sizeof(parked));
+            LaneMask live = ~parked;
+            if (!lanes_any(&live)) {
+                break;
+            }
+
+            // Refilled lanes start again from their pixel's point, with the checkpoint there.
+            // Same mapping from pixel to complex plane as calculate_julia_array_range_scalar
+            DoubleLanes x, y;
+            DoubleDoubleLanes start_real, start_imag;
+            memcpy(&x, lane_x, sizeof(x));
+            memcpy(&y, lane_y, sizeof(y));
+            double_double_coordinates(&start_real, VIEW_XMIN, VIEW_XMAX, width, &x);
+            double_double_coordinates(&start_imag, VIEW_YMIN, VIEW_YMAX, HEIGHT, &y);
+            lanes_replace(&z_real.hi, &done, &start_real.hi);
+            lanes_replace(&z_real.lo, &done, &start_real.lo);
+            lanes_replace(&z_imag.hi, &done, &start_imag.hi);
+            lanes_replace(&z_imag.lo, &done, &start_imag.lo);
+            lanes_replace(&iteration, &done, &zero);
+            lanes_replace(&check_real, &done, &start_real.hi);
+            lanes_replace(&check_imag, &done, &start_imag.hi);
+            lanes_replace(&check_interval, &done, &one);
+            lanes_replace(&check_steps, &done, &zero);
+            periodic_lanes &= ~done;
+            trapped_lanes &= ~done;
+
+            // Parked lanes iterate z = 0 with c = 0, so they stay at 0 rather than running off to infinity
+            lanes_replace(&z_real.hi, &parked, &zero);
+            lanes_replace(&z_real.lo, &parked, &zero);
+            lanes_replace(&z_imag.hi, &parked, &zero);
+            lanes_replace(&z_imag.lo, &parked, &zero);
+            lanes_replace(&c_real.hi, &parked, &zero);
+            lanes_replace(&c_imag.hi, &parked, &zero);
+            continue;
+        }
+
+        // z = z^2 + c: re = x^2 - y^2 + c_real, im = 2xy + c_imag
+        DoubleDoubleLanes real_squared, imag_squared, cross, next_real, next_imag;
+        double_double_mul(&real_squared, &z_real, &z_real);
+        double_double_mul(&imag_squared, &z_imag, &z_imag);
+        double_double_mul(&cross, &z_real, &z_imag);
+        imag_squared.hi = -imag_squared.hi;
+        imag_squared.lo = -imag_squared.lo;
+        cross.hi *= 2.0;
+        cross.lo *= 2.0;
+        double_double_add(&next_real, &real_squared, &imag_squared);
+        double_double_add(&next_real, &next_real, &c_real);
+        double_double_add(&next_imag, &cross, &c_imag);
+
+        // Every lane that is not parked is running here, so all of them count the step
+        z_real = next_real;
+        z_imag = next_imag;
+        iteration += one;
+
+        if (ATTRACTING_CYCLE_TRAP && julia_cycle.found) {
+
+            // Lanes whose orbit reached the attracting cycle will stay on it
+            DoubleLanes distance_real = z_real.hi - julia_cycle.point.real;
+            DoubleLanes distance_imag = z_imag.hi - julia_cycle.point.imag;
+            LaneMask trapped = (distance_real * distance_real + distance_imag * distance_imag < julia_cycle.radius * julia_cycle.radius);
+            trapped_lanes |= trapped & ~parked;
+        }
+
+        if (PERIODICITY_CHECK) {
+
+            // Lanes whose orbit came back to the checkpoint are caught in a cycle and never escape.
+            // The tolerance is a disc rather than a square here, to keep the mask a single comparison
+            DoubleLanes distance_real = z_real.hi - check_real;
+            DoubleLanes distance_imag = z_imag.hi - check_imag;
+            LaneMask periodic = (distance_real * distance_real + distance_imag * distance_imag < PERIODICITY_TOLERANCE * PERIODICITY_TOLERANCE);
+            periodic_lanes |= periodic & ~(parked | trapped_lanes);
+
+            // Move each lane's checkpoint to its current point after 1, 2, 4, 8... of its iterations
+            check_steps += one;
+            LaneMask move = check_steps == check_interval;
+            DoubleLanes doubled = check_interval + check_interval;
+            lanes_replace(&check_real, &move, &z_real.hi);
+            lanes_replace(&check_imag, &move, &z_imag.hi);
+            lanes_replace(&check_interval, &move, &doubled);
+            lanes_replace(&check_steps, &move, &zero);
+        }
+    }
+}
+
+// Same kernel compiled for each target; the vector types take the widest registers available
+void calculate_julia_array_range_double_double(int width, int start_row, int end_row, int *result, double real, double imaginary, const int *pixels, int pixel_count) {
+    julia_double_double_lanes(width, start_row, end_row, result, real, imaginary, pixels, pixel_count);
+}
+
+#ifdef X86_KERNELS
+__attribute__((target("avx2")))
+void calculate_julia_array_range_double_double_avx2(int width, int start_row, int end_row, int *result, double real, double imaginary, const int *pixels, int pixel_count) {
+    julia_double_double_lanes(width, start_row, end_row, result, real, imaginary, pixels, pixel_count);
+}
+
+__attribute__((target("avx512f")))
+void calculate_julia_array_range_double_double_avx512(int width, int start_row, int end_row, int *result, double real, double imaginary, const int *pixels, int pixel_count) {
+    julia_double_double_lanes(width, start_row, end_row, result, real, imaginary, pixels, pixel_count);
+}
+#endif
+#endif
+
+int view_is_symmetric(void) {
+
+    // Pixel (x, y) sits at -z of pixel (WIDTH - x, HEIGHT - y) only when the view is centred on 0
+    return VIEW_XMIN == -VIEW_XMAX && VIEW_YMIN == -VIEW_YMAX;
+}
+
+void mirror_julia_rows(int width, int start_row, int mirror_start, int mirror_end, const int *source, int *result, double real, double imaginary) {
+
+    // Row y is row HEIGHT - y turned around, so pixel (x, y) copies pixel (width - x, HEIGHT - y).
+    // Column 0 would copy column width, which is just outside the frame, so compute it instead
+    for (int y = mirror_start; y < mirror_end; y++) {
+        const int *source_row = &source[(HEIGHT - y - start_row) * width];
+        int *result_row = &result[(y - mirror_start) * width];
+
+        result_row[0] = julia_pixel_value(width, 0, y, real, imaginary);
+        if (WORKER_COLOR) {
+            result_row[0] = pixel_color(result_row[0]);
+        }
+        for (int x = 1; x < width; x++) {
+            result_row[x] = source_row[width - x];
+        }
+    }
+}
+
+void calculate_julia_array_range_threaded(int width, int start_row, int end_row, int *result, double real, double imaginary) {
+
+    // The trap is set up once here, the worker threads only read it
+    prepare_julia_cycle(real, imaginary);
+
+    int tile_columns = (width + THREAD_TILE_SIZE - 1) / THREAD_TILE_SIZE;
+    int tile_rows = (end_row - start_row + THREAD_TILE_SIZE - 1) / THREAD_TILE_SIZE;
+    int tiles = tile_columns * tile_rows;
+
+    TilePool pool = {.width = width, .start_row = start_row, .end_row = end_row, .result = result,
+                     .real = real, .imaginary = imaginary, .tile_columns = tile_columns};
+
+    // Each thread starts with an equal run of consecutive tiles. The runs in the middle of
+    // the frame cost the most, and the threads that finish early steal from them
+    for (int thread = 0; thread < THREADS_PER_RANK; thread++) {
+        pthread_mutex_init(&pool.deques[thread].lock, NULL);
+        pool.deques[thread].front = (int)((long long)tiles * thread / THREADS_PER_RANK);
+        pool.deques[thread].back = (int)((long long)tiles * (thread + 1) / THREADS_PER_RANK);
+    }
+
+    // The calling thread works as thread 0 while the others run
+    TileWorker workers[THREADS_PER_RANK];
+    pthread_t threads[THREADS_PER_RANK];
+    for (int thread = 0; thread < THREADS_PER_RANK; thread++) {
+        workers[thread].pool = &pool;
+        workers[thread].thread = thread;
+        if (thread > 0 && pthread_create(&threads[thread], NULL, julia_tile_worker, &workers[thread]) != 0) {
+            fprintf(stderr, "Error: Could not start worker thread %d\n", thread);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    julia_tile_worker(&workers[0]);
+
+    // Thread 0 has counted straight into the calling thread's counters
+    for (int thread = 1; thread < THREADS_PER_RANK; thread++) {
+        pthread_join(threads[thread], NULL);
+        periodicity_resolved_pixels += workers[thread].periodicity_resolved_pixels;
+        trap_resolved_pixels += workers[thread].trap_resolved_pixels;
+    }
+    for (int thread = 0; thread < THREADS_PER_RANK; thread++) {
+        pthread_mutex_destroy(&pool.deques[thread].lock);
+    }
+}
+
+void *julia_tile_worker(void *argument) {
+
+    TileWorker *worker = argument;
+    TilePool *pool = worker->pool;
+    int rows = pool->end_row - pool->start_row;
+
+    int *pixels = malloc(sizeof(int) * THREAD_TILE_SIZE * THREAD_TILE_SIZE);
+    if (pixels == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
+    // The kernels take a list of pixels of the block, so a tile is just the list of its pixels
+    int tile;
+    while ((tile = take_tile(pool, worker->thread)) >= 0) {
+        int x0 = (tile % pool->tile_columns) * THREAD_TILE_SIZE;
+        int y0 = (tile / pool->tile_columns) * THREAD_TILE_SIZE;
+        int x1 = x0 + THREAD_TILE_SIZE < pool->width ? x0 + THREAD_TILE_SIZE : pool->width;
+        int y1 = y0 + THREAD_TILE_SIZE < rows ? y0 + THREAD_TILE_SIZE : rows;
+
+        int pixel_count = 0;
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) {
+                pixels[pixel_count++] = y * pool->width + x;
+            }
+        }
+        julia_kernel(pool->width, pool->start_row, pool->end_row, pool->result, pool->real, pool->imaginary, pixels, pixel_count);
+        if (WORKER_COLOR) {
+            for (int i = 0; i < pixel_count; i++) {
+                pool->result[pixels[i]] = pixel_color(pool->result[pixels[i]]);
+            }
+        }
+    }
 
-#define WIDTH 10000
-#define HEIGHT 10000
-#define MAX_ITERATION 1000
+    // Threads other than 0 started their thread-local counters at 0, so these are their own counts
+    worker->periodicity_resolved_pixels = periodicity_resolved_pixels;
+    worker->trap_resolved_pixels = trap_resolved_pixels;
 
-#define REAL_NUMBER -0.726990
-#define IMAGINARY_NUMBER 0.188990
+    free(pixels);
+    return NULL;
+}
 
-// so far 1, 3, 16 are actually kind of nice lolol 
-// 14 are a bit odd 
-#define COLOR_CHOICE 16
+int take_tile(TilePool *pool, int thread) {
 
-typedef struct {
-    double real;
-    double imag;
-} Complex;
+    // Own tiles first, in order
+    int tile = -1;
+    TileDeque *own = &pool->deques[thread];
+    pthread_mutex_lock(&own->lock);
+    if (own->front < own->back) {
+        tile = own->front++;
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    // Then the last tile of the next thread that has any left
+    for (int i = 1; tile < 0 && i < THREADS_PER_RANK; i++) {
+        TileDeque *victim = &pool->deques[(thread + i) % THREADS_PER_RANK];
+        pthread_mutex_lock(&victim->lock);
+        if (victim->front < victim->back) {
+            tile = --victim->back;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
 
-void calculate_julia_array_range(int width, int start_row, int end_row, int *result, double real, double imaginary);
-void map_to_color(int iteration, int *red, int *green, int *blue, int color_choice);
-double hue_to_rgb(double hue, double saturation, double lightness);
+    // No tiles are added once the threads run, so -1 means the block is done
+    return tile;
+}
 
+void calculate_julia_block(int start_row, int end_row, int *result, const ReferenceOrbit *reference) {
 
-void calculate_julia_array_range(int width, int start_row, int end_row, int *result, double real, double imaginary) {
-    
-    // Define constant for Julia set
-    Complex constant = {.real = real, .imag = imaginary}; // Example constant
+    // Engine picked by the compile-time switches
+    if (DEEP_ZOOM) {
+        calculate_julia_array_range_perturbation(WIDTH, start_row, end_row, result, reference);
+    } else if (MARIANI_SILVER) {
+        calculate_julia_array_range_mariani_silver(WIDTH, start_row, end_row, result, REAL_NUMBER, IMAGINARY_NUMBER);
+    } else if (THREADS_PER_RANK > 1) {
+
+        // The threads colour their own tiles
+        calculate_julia_array_range_threaded(WIDTH, start_row, end_row, result, REAL_NUMBER, IMAGINARY_NUMBER);
+        return;
 
-    // Iterate through rows within the specified range
-    for (int y = start_row; y < end_row; y++) {
-        for (int x = 0; x < width; x++) {
+    } else {
+        calculate_julia_array_range(WIDTH, start_row, end_row, result, REAL_NUMBER, IMAGINARY_NUMBER);
+    }
+
+    // Colour the block while it is still in cache
+    if (WORKER_COLOR) {
+        color_pixels(result, result, WIDTH * (end_row - start_row));
+    }
+}
+
+int *calculate_julia_rows_dynamic(int unique_rows, const ReferenceOrbit *reference, int **chunk_rows, int *chunk_count, int *row_count) {
+
+    MPI_Win counter = open_work_counter();
+
+    // Rows of all chunks this rank took, back to back, and the first row of each chunk
+    int capacity = 0;
+    int *result = NULL;
+    *chunk_rows = NULL;
+    *chunk_count = 0;
+    *row_count = 0;
 
-            // Map pixel coordinates (x, y) directly to the rectangular region in the complex plane
-            // The complex plane is mapped to a rectangular region defined by:
-            // - Real part (x-axis): Range from -1.75 (leftmost) to 1.75 (rightmost)
-            // - Imaginary part (y-axis): Range from -1.75 (bottom) to 1.75 (top)
-            // The width and height of the rectangular region are adjusted to match the aspect ratio of the image.
-            Complex z = {.real = x / (double)width * 3.5 - 1.75, .imag = y / (double)HEIGHT * 3.5 - 1.75};
-            int iteration = 0;
-            while (z.real * z.real + z.imag * z.imag <= 4.0 && iteration < MAX_ITERATION) {
-                double temp = z.real * z.real - z.imag * z.imag + constant.real;
-                z.imag = 2.0 * z.real * z.imag + constant.imag;
-                z.real = temp;
-                iteration++;
+    MPI_Win_lock_all(0, counter);
+    for (int start_row = take_from_counter(counter, ROW_CHUNK_SIZE); start_row < unique_rows; start_row = take_from_counter(counter, ROW_CHUNK_SIZE)) {
+
+        int end_row = start_row + row_chunk_length(start_row, unique_rows);
+
+        // Every chunk has at least one row, so the chunk list never outgrows the row buffer
+        if (*row_count + ROW_CHUNK_SIZE > capacity) {
+            capacity = 2 * capacity + ROW_CHUNK_SIZE;
+            result = realloc(result, sizeof(int) * WIDTH * capacity);
+            *chunk_rows = realloc(*chunk_rows, sizeof(int) * capacity);
+            if (result == NULL || *chunk_rows == NULL) {
+                fprintf(stderr, "Error: Memory allocation failed\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
             }
+        }
+
+        calculate_julia_block(start_row, end_row, &result[*row_count * WIDTH], reference);
+        (*chunk_rows)[(*chunk_count)++] = start_row;
+        *row_count += end_row - start_row;
+    }
+    MPI_Win_unlock_all(counter);
+    MPI_Win_free(&counter);
+
+    // A rank that got no chunk still hands back buffers it can send and free
+    if (result == NULL) {
+        result = malloc(sizeof(int));
+        *chunk_rows = malloc(sizeof(int));
+        if (result == NULL || *chunk_rows == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+
+    return result;
+}
+
+int *calculate_julia_row_chunks(int unique_rows, const ReferenceOrbit *reference, const int *chunk_rows, int chunk_count, int *row_count) {
+
+    *row_count = 0;
+    for (int i = 0; i < chunk_count; i++) {
+        *row_count += row_chunk_length(chunk_rows[i], unique_rows);
+    }
+
+    int *result = malloc(sizeof(int) * WIDTH * (*row_count > 0 ? *row_count : 1));
+    if (result == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // Chunks are stored back to back, in the order of the list
+    int *rows = result;
+    for (int i = 0; i < chunk_count; i++) {
+        int chunk_length = row_chunk_length(chunk_rows[i], unique_rows);
+        calculate_julia_block(chunk_rows[i], chunk_rows[i] + chunk_length, rows, reference);
+        rows += WIDTH * chunk_length;
+    }
+
+    return result;
+}
+
+void calculate_julia_tile(Tile tile, int *result, int *row, int *pixels) {
+
+    // The kernels map a pixel to the plane through its place in a full-width row, so each row
+    // of the tile is computed into a row buffer as a list of its pixels and copied out
+    for (int i = 0; i < tile.width; i++) {
+        pixels[i] = tile.x + i;
+    }
+    for (int y = 0; y < tile.height; y++) {
+        julia_kernel(WIDTH, tile.y + y, tile.y + y + 1, row, REAL_NUMBER, IMAGINARY_NUMBER, pixels, tile.width);
+        memcpy(&result[y * tile.width], &row[tile.x], sizeof(int) * tile.width);
+        if (WORKER_COLOR) {
+            color_pixels(&result[y * tile.width], &result[y * tile.width], tile.width);
+        }
+    }
+}
+
+int *calculate_julia_tiles(int unique_rows, const int *tiles, int tile_count, int *pixel_count) {
+
+    *pixel_count = 0;
+    for (int i = 0; i < tile_count; i++) {
+        Tile tile = image_tile(tiles[i], unique_rows);
+        *pixel_count += tile.width * tile.height;
+    }
+
+    int *result = malloc(sizeof(int) * (*pixel_count > 0 ? *pixel_count : 1));
+    int *row = malloc(sizeof(int) * WIDTH);
+    int *pixels = malloc(sizeof(int) * TILE_WIDTH);
+    if (result == NULL || row == NULL || pixels == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // The trap is set up once, before any tile is computed
+    prepare_julia_cycle(REAL_NUMBER, IMAGINARY_NUMBER);
+
+    // Tiles are stored back to back, each row by row, in the order of the list
+    int *tile_pixels = result;
+    for (int i = 0; i < tile_count; i++) {
+        Tile tile = image_tile(tiles[i], unique_rows);
+        calculate_julia_tile(tile, tile_pixels, row, pixels);
+        tile_pixels += tile.width * tile.height;
+    }
+
+    free(row);
+    free(pixels);
+    return result;
+}
+
+int *calculate_julia_tiles_dynamic(int unique_rows, int **tiles, int *tile_count, int *pixel_count) {
+
+    MPI_Win counter = open_work_counter();
+    int total_tiles = tile_total(unique_rows);
+
+    // Pixels of all tiles this rank took, back to back, and the index of each tile
+    int capacity = 0, tile_capacity = 0;
+    int *result = NULL;
+    *tiles = NULL;
+    *tile_count = 0;
+    *pixel_count = 0;
+
+    int *row = malloc(sizeof(int) * WIDTH);
+    int *pixels = malloc(sizeof(int) * TILE_WIDTH);
+    if (row == NULL || pixels == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // The trap is set up once, before any tile is computed
+    prepare_julia_cycle(REAL_NUMBER, IMAGINARY_NUMBER);
+
+    MPI_Win_lock_all(0, counter);
+    for (int index = take_from_counter(counter, 1); index < total_tiles; index = take_from_counter(counter, 1)) {
+
+        Tile tile = image_tile(index, unique_rows);
+        if (*pixel_count + TILE_WIDTH * TILE_HEIGHT > capacity) {
+            capacity = 2 * capacity + TILE_WIDTH * TILE_HEIGHT;
+            result = realloc(result, sizeof(int) * capacity);
+        }
+        if (*tile_count == tile_capacity) {
+            tile_capacity = 2 * tile_capacity + 1;
+            *tiles = realloc(*tiles, sizeof(int) * tile_capacity);
+        }
+        if (result == NULL || *tiles == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        calculate_julia_tile(tile, &result[*pixel_count], row, pixels);
+        (*tiles)[(*tile_count)++] = index;
+        *pixel_count += tile.width * tile.height;
+    }
+    MPI_Win_unlock_all(counter);
+    MPI_Win_free(&counter);
+
+    free(row);
+    free(pixels);
+
+    // A rank that got no tile still hands back buffers it can send and free
+    if (result == NULL) {
+        result = malloc(sizeof(int));
+        *tiles = malloc(sizeof(int));
+        if (result == NULL || *tiles == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+
+    return result;
+}
+
+double *estimate_julia_row_costs(int rank, int size, int unique_rows) {
+
+    // Coarse rows are dealt out cyclically, so the preview itself is balanced
+    int preview_rows = (unique_rows + COST_PREVIEW_SCALE - 1) / COST_PREVIEW_SCALE;
+    int preview_columns = (WIDTH + COST_PREVIEW_SCALE - 1) / COST_PREVIEW_SCALE;
+    double *preview_costs = calloc(preview_rows, sizeof(double));
+    double *row_costs = malloc(sizeof(double) * unique_rows);
+    int *pixels = malloc(sizeof(int) * preview_columns);
+    int *result = malloc(sizeof(int) * WIDTH);
+    if (preview_costs == NULL || row_costs == NULL || pixels == NULL || result == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    for (int x = 0; x < preview_columns; x++) {
+        pixels[x] = x * COST_PREVIEW_SCALE;
+    }
 
-            // Store the result in the result array based on the iteration count
-            if (iteration == MAX_ITERATION) {
-                result[(y - start_row) * width + x] = 0;  // Inside julia set
-            } else {
-                result[(y - start_row) * width + x] = iteration;  // Outside julia set
+    // The preview must not show up in the counters of the render
+    long long saved_periodicity = periodicity_resolved_pixels;
+    long long saved_trap = trap_resolved_pixels;
+    prepare_julia_cycle(REAL_NUMBER, IMAGINARY_NUMBER);
+
+    for (int i = rank; i < preview_rows; i += size) {
+        int y = i * COST_PREVIEW_SCALE;
+        julia_kernel(WIDTH, y, y + 1, result, REAL_NUMBER, IMAGINARY_NUMBER, pixels, preview_columns);
+        for (int x = 0; x < preview_columns; x++) {
+            // A count of 0 is either inside, which costs the full MAX_ITERATION, or a start outside
+            // the escape radius, which costs nothing. Every pixel also costs about 15 iterations of set-up
+            int count = result[pixels[x]];
+            if (count == 0) {
+                double z_real = pixels[x] / (double)WIDTH * (VIEW_XMAX - VIEW_XMIN) + VIEW_XMIN;
+                double z_imag = y / (double)HEIGHT * (VIEW_YMAX - VIEW_YMIN) + VIEW_YMIN;
+                count = z_real * z_real + z_imag * z_imag > 4.0 ? 0 : MAX_ITERATION;
             }
+            preview_costs[i] += count + 15;
         }
     }
+
+    periodicity_resolved_pixels = saved_periodicity;
+    trap_resolved_pixels = saved_trap;
+
+    MPI_Allreduce(MPI_IN_PLACE, preview_costs, preview_rows, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+    // Every row costs as much as the preview row above it
+    for (int y = 0; y < unique_rows; y++) {
+        row_costs[y] = preview_costs[y / COST_PREVIEW_SCALE];
+    }
+
+    free(preview_costs);
+    free(pixels);
+    free(result);
+    return row_costs;
 }
 
+
 void map_to_color(int iteration, int *red, int *green, int *blue, int color_choice) {
     double t;
     double hue;
@@ -416,9 +2349,17 @@ int main(int argc, char *argv[]) {
     int rank, size;
     double start_time, end_time, elapsed_time, tick;
 
-    MPI_Init(&argc, &argv);
+    // Only the main thread calls MPI, the worker threads of THREADS_PER_RANK just compute
+    int thread_support;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &thread_support);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
+    if (THREADS_PER_RANK > 1 && thread_support < MPI_THREAD_FUNNELED && rank == 0) {
+        fprintf(stderr, "Warning: The MPI library does not support threads, THREADS_PER_RANK may not be safe\n");
+    }
+
+    // Pick the fastest row kernel this rank's CPU supports
+    select_julia_kernel(rank);
 
     // Returns the precision of the results returned by MPI_Wtime
     tick = MPI_Wtick();
@@ -428,9 +2369,82 @@ int main(int argc, char *argv[]) {
 
     start_time = MPI_Wtime();
 
+    // Reference orbit for the deep zoom engine, computed once on rank 0 and broadcast
+    ReferenceOrbit reference = {.length = 0};
+    if (DEEP_ZOOM) {
+        prepare_reference_orbit(rank, &reference);
+    }
+
+    // Tiles are computed with the row kernels, the other engines work on whole rows
+    int tiled = TILE_DECOMPOSITION && !DEEP_ZOOM && !MARIANI_SILVER && !GIGAPIXEL_MODE;
+
+    // MPI-IO output writes each rank's pixels where they are, so the rows rank 0 would mirror after
+    // the gather are computed instead. TIFF tiles must be multiples of 16 pixels
+    int mpi_io = MPI_IO_OUTPUT == 2 || (MPI_IO_OUTPUT == 1 && TILE_WIDTH % 16 == 0 && TILE_HEIGHT % 16 == 0);
+
+    // DZI pyramids are built from each rank's own rows, so they need the ranks to hold consecutive rows,
+    // and tiles a browser can show
+    int dzi = DZI_OUTPUT && !mpi_io && !tiled && !GIGAPIXEL_MODE && (ROW_SCHEDULE == 0 || ROW_SCHEDULE == 3) && IMAGE_ENCODER != 2 && IMAGE_ENCODER != 4;
+
+    // Colour every iteration count once, so no pixel runs map_to_color. Only a single PNG can use a palette,
+    // as the lower levels of a pyramid mix colours
+    build_color_table(!mpi_io && !dzi && IMAGE_ENCODER <= 1);
+
+    // With symmetry on only rows 0 .. HEIGHT / 2 are computed, the rest are mirrored from them
+    int symmetric = SYMMETRY_MODE && !DEEP_ZOOM && view_is_symmetric() && !(mpi_io && (tiled || ROW_SCHEDULE == 1 || ROW_SCHEDULE == 2)) && !GIGAPIXEL_MODE && !dzi;
+    int unique_rows = symmetric ? HEIGHT / 2 + 1 : HEIGHT;
+
+    // Parallel deflate needs each rank's rows to follow on from the previous rank's, and a PNG encoder
+    int parallel_deflate = PARALLEL_DEFLATE && !tiled && !GIGAPIXEL_MODE && (ROW_SCHEDULE == 0 || ROW_SCHEDULE == 3) && IMAGE_ENCODER <= 1 && !dzi;
+
+    // Streaming sends whole rows in file order: each rank's strip, or each chunk of the dynamic and
+    // block-cyclic schedules, whose mirrored rows its rank then computes like a strip's
+    int streamed = STREAM_ROWS > 0 && !tiled && !GIGAPIXEL_MODE;
+    int mirrored_chunks = symmetric && streamed && (ROW_SCHEDULE == 1 || ROW_SCHEDULE == 2);
+
+    // Outside gigapixel mode, strips and the assembled image are indexed with int
+    if (!GIGAPIXEL_MODE && (long long)WIDTH * HEIGHT > INT_MAX) {
+        if (rank == 0) {
+            fprintf(stderr, "Error: %dx%d has 2^31 pixels or more, turn on GIGAPIXEL_MODE\n", WIDTH, HEIGHT);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    // Name the requested switches this configuration turns off, before any work starts
+    if (rank == 0) {
+        if (TILE_DECOMPOSITION && !tiled) {
+            printf("Tile decomposition: off, deep zoom, Mariani-Silver and gigapixel mode work on whole rows\n");
+        }
+        if (ROW_SCHEDULE == 3 && tiled) {
+            printf("Row schedule 3: tiles are split evenly, as with schedule 0\n");
+        }
+        if (THREADS_PER_RANK > 1 && (tiled || DEEP_ZOOM || MARIANI_SILVER)) {
+            printf("Worker threads: off, tiles, deep zoom and Mariani-Silver run on one thread per rank\n");
+        }
+        if (MPI_IO_OUTPUT && !mpi_io) {
+            printf("MPI-IO output: off, TILE_WIDTH and TILE_HEIGHT must be multiples of 16 for the TIFF, writing a PNG\n");
+        }
+        if (PALETTE_OUTPUT && png_color_type == PNG_COLOR_TYPE_RGBA) {
+            printf("Palette output: off, only a single PNG can use a palette\n");
+        }
+        if (PARALLEL_DEFLATE && !parallel_deflate) {
+            printf("Parallel deflate: off, it needs ROW_SCHEDULE 0 or 3 without tiles, gigapixel mode or DZI output, and a PNG encoder\n");
+        }
+        if (STREAM_ROWS > 0 && mpi_io) {
+            printf("Streamed rows: off, MPI-IO output writes every rank's rows in place\n");
+        }
+        if (DZI_OUTPUT && !dzi) {
+            printf("DZI output: off, it needs ROW_SCHEDULE 0 or 3 without tiles, gigapixel mode or MPI-IO output, and a PNG or JPEG encoder\n");
+        }
+        if (SYMMETRY_MODE && !symmetric) {
+            printf("Symmetry mode: off, view is not centred on 0, deep zoom or gigapixel mode is on, or MPI-IO or DZI output needs every row computed\n");
+        }
+    }
+
    // Determine rows to compute for each process
-    int rows_per_process = HEIGHT / size;
-    int remaining_rows = HEIGHT % size; // Rows left after distributing evenly
+    int rows_per_process = unique_rows / size;
+    int remaining_rows = unique_rows % size; // Rows left after distributing evenly
 
     int start_row, end_row;
 
@@ -444,154 +2458,508 @@ int main(int argc, char *argv[]) {
         end_row = start_row + rows_per_process;
     }
 
-    int local_total_elements = WIDTH * (end_row - start_row);
+    // Blocks of equal estimated cost instead of equal size. Deep zoom views are too small for
+    // the double kernels the preview uses, so they keep the equal split
+    double planning_time = 0.0;
+    if (ROW_SCHEDULE == 3 && !DEEP_ZOOM && !tiled && !GIGAPIXEL_MODE) {
+        planning_time = MPI_Wtime();
+        double *row_costs = estimate_julia_row_costs(rank, size, unique_rows);
+        split_rows_by_cost(row_costs, unique_rows, rank, size, &start_row, &end_row);
+        free(row_costs);
+        planning_time = MPI_Wtime() - planning_time;
+    }
+
+    int local_total_elements = GIGAPIXEL_MODE ? 0 : WIDTH * (end_row - start_row);
+
+    // First row of each chunk this rank took in the dynamic and block-cyclic schedules
+    int *chunk_rows = NULL;
+    int chunk_count = 0;
+
+    // Tiles this rank took in tile decomposition mode
+    int *tiles = NULL;
+    int tile_count = 0;
+
+    double compute_start_time = MPI_Wtime();
 
      // Allocate memory for local julia sets on each process
     int *local_julia_set;
-    local_julia_set = malloc(sizeof(int) * local_total_elements);
-    if (local_julia_set == NULL) {
+    if (GIGAPIXEL_MODE) {
+
+        // The chunks are computed as they are written, further down
+        local_julia_set = malloc(sizeof(int));
+
+    } else if (tiled && ROW_SCHEDULE == 1) {
+
+        // Generate tiles until the shared counter runs past the last tile
+        local_julia_set = calculate_julia_tiles_dynamic(unique_rows, &tiles, &tile_count, &local_total_elements);
+
+    } else if (tiled) {
+
+        // Every rank knows which tiles it owns, rank 0 included
+        tiles = assigned_tiles(rank, size, unique_rows, &tile_count);
+        local_julia_set = calculate_julia_tiles(unique_rows, tiles, tile_count, &local_total_elements);
+
+    } else if (ROW_SCHEDULE == 1) {
+
+        // Generate chunks of the julia set until the shared counter runs past the last row
+        int row_count;
+        local_julia_set = calculate_julia_rows_dynamic(unique_rows, &reference, &chunk_rows, &chunk_count, &row_count);
+        local_total_elements = WIDTH * row_count;
+
+    } else if (ROW_SCHEDULE == 2) {
+
+        // Every rank knows which chunks it owns, rank 0 included
+        int row_count;
+        chunk_rows = block_cyclic_chunk_rows(rank, size, unique_rows, &chunk_count);
+        local_julia_set = calculate_julia_row_chunks(unique_rows, &reference, chunk_rows, chunk_count, &row_count);
+        local_total_elements = WIDTH * row_count;
+
+    } else {
+
+        local_julia_set = malloc(sizeof(int) * local_total_elements);
+        if (local_julia_set == NULL) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        // Generate the julia set
+        calculate_julia_block(start_row, end_row, local_julia_set, &reference);
+    }
+
+    double compute_time = MPI_Wtime() - compute_start_time;
+    int local_rows = local_total_elements / WIDTH;
+
+    // Rows HEIGHT - end_row + 1 .. HEIGHT - start_row mirror this rank's rows (row 0 has no mirror)
+    // (with tiles and in the dynamic and block-cyclic schedules rank 0 mirrors the assembled rows instead,
+    // unless the chunks are streamed, when each chunk's rank mirrors it)
+    int mirror_start = 0, mirror_end = 0;
+    if (symmetric && !tiled && (ROW_SCHEDULE == 0 || ROW_SCHEDULE == 3)) {
+        mirror_start = HEIGHT - end_row + 1 > unique_rows ? HEIGHT - end_row + 1 : unique_rows;
+        mirror_end = HEIGHT - start_row + 1 < HEIGHT ? HEIGHT - start_row + 1 : HEIGHT;
+        if (mirror_end < mirror_start) {
+            mirror_end = mirror_start;
+        }
+    }
+
+    int local_mirror_elements = WIDTH * (mirror_end - mirror_start);
+    if (mirrored_chunks) {
+        for (int i = 0; i < chunk_count; i++) {
+            int first_mirror_row;
+            local_mirror_elements += WIDTH * chunk_mirror_rows(chunk_rows[i], unique_rows, &first_mirror_row);
+        }
+    }
+    int *local_mirror_set = malloc(sizeof(int) * (local_mirror_elements > 0 ? local_mirror_elements : 1));
+    if (local_mirror_set == NULL) {
         fprintf(stderr, "Error: Memory allocation failed\n");
-        MPI_Finalize();
-        return 1;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // Gigapixel mode keeps no rows here, and symmetry is off there
+    if (!GIGAPIXEL_MODE) {
+        mirror_julia_rows(WIDTH, start_row, mirror_start, mirror_end, local_julia_set, local_mirror_set, REAL_NUMBER, IMAGINARY_NUMBER);
     }
 
-    // Generate the julia set
-    calculate_julia_array_range(WIDTH, start_row, end_row, local_julia_set, REAL_NUMBER, IMAGINARY_NUMBER);
+    // Mirrored chunks are sent last chunk first, as the file has them
+    if (mirrored_chunks) {
+        int source_row = local_rows, mirror_row = 0;
+        for (int i = chunk_count - 1; i >= 0; i--) {
+            int first_mirror_row;
+            int count = chunk_mirror_rows(chunk_rows[i], unique_rows, &first_mirror_row);
+            source_row -= row_chunk_length(chunk_rows[i], unique_rows);
+            mirror_julia_rows(WIDTH, chunk_rows[i], first_mirror_row, first_mirror_row + count, &local_julia_set[source_row * WIDTH],
+                              &local_mirror_set[mirror_row * WIDTH], REAL_NUMBER, IMAGINARY_NUMBER);
+            mirror_row += count;
+        }
+    }
 
-    // Send and Receive local results (instead of Gather)
-    if (rank != 0) {
+    char filename[100]; // Buffer to hold the filename
 
-        // Send local_julia_set size (consider uneven distribution)
-        MPI_Send(&local_total_elements, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
-        MPI_Send(local_julia_set, local_total_elements, MPI_INT, 0, 1, MPI_COMM_WORLD);
+    // Format the filename with height and width, and the extension of the output format
+    snprintf(filename, sizeof(filename), "julia-set_%dx%d_color-%d_iterations-%d_real-%f_imaginary-%f.%s", WIDTH, HEIGHT, COLOR_CHOICE, MAX_ITERATION, REAL_NUMBER, IMAGINARY_NUMBER,
+             mpi_io ? (MPI_IO_OUTPUT == 1 ? "tif" : "raw") : image_extensions[IMAGE_ENCODER]);
 
-    } else { // Root process receives from all processes
+    if (mpi_io) {
+
+        int error;
+        if (GIGAPIXEL_MODE) {
+
+            // Every rank computes and writes its chunks in turn
+            error = write_gigapixel_file(filename, rank, size, &reference, &compute_time, &local_rows);
+
+        } else {
+
+            // The TIFF holds RGBA pixels, the raw container whatever the ranks hold
+            if (MPI_IO_OUTPUT == 1 && !WORKER_COLOR) {
+                color_pixels(local_julia_set, local_julia_set, local_total_elements);
+                color_pixels(local_mirror_set, local_mirror_set, local_mirror_elements);
+            }
+
+            int run_count;
+            FileRun *runs = local_file_runs(unique_rows, tiled, start_row, end_row, local_julia_set, tiles, tile_count,
+                                            chunk_rows, chunk_count, mirror_start, mirror_end, local_mirror_set, &run_count);
+            MPI_File file;
+            error = open_output_file(filename, &file);
+            error |= write_file_runs(file, runs, run_count);
+            error |= MPI_File_close(&file) != MPI_SUCCESS;
+            free(runs);
+        }
+        if (error) {
+            fprintf(stderr, "Error writing %s with MPI-IO\n", filename);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        if (rank == 0) {
+            printf("\n%s image created successfully: %s \n", MPI_IO_OUTPUT == 1 ? "TIFF" : "Raw", filename);
+        }
 
-        char filename[100]; // Buffer to hold the filename
+        free(local_julia_set);
+        free(local_mirror_set);
+        free(chunk_rows);
+        free(tiles);
 
-        // Format the filename with height and width
-        snprintf(filename, sizeof(filename), "julia-set_%dx%d_color-%d_iterations-%d_real-%f_imaginary-%f.png", WIDTH, HEIGHT, COLOR_CHOICE, MAX_ITERATION, REAL_NUMBER, IMAGINARY_NUMBER);
+    } else if (dzi) {
 
-        // Open file for writing (binary mode)
-        FILE *fp = fopen(filename, "wb");
-        if (!fp) {
-            fprintf(stderr, "Error opening file for writing\n");
-            return 1;
+        // Every rank colours its rows and writes its part of each level
+        if (!WORKER_COLOR) {
+            color_pixels(local_julia_set, local_julia_set, local_total_elements);
+        }
+        if (write_dzi_pyramid(filename, (unsigned char *)local_julia_set, start_row, end_row, rank, size)) {
+            fprintf(stderr, "Error writing the DZI tiles of %s\n", filename);
+            MPI_Abort(MPI_COMM_WORLD, 1);
         }
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (rank == 0) {
+            printf("\nDZI pyramid created successfully: %.*s.dzi \n", (int)(strrchr(filename, '.') - filename), filename);
+        }
+
+        free(local_julia_set);
+        free(local_mirror_set);
+        free(chunk_rows);
+        free(tiles);
+
+    } else if (parallel_deflate) {
+
+        // The rows are compressed where they were computed. Computed rows come in rank order and
+        // mirrored rows in reverse rank order, and each rank sends its two segments in that order
+        if (rank != 0) {
+            send_png_segment(local_julia_set, local_total_elements / WIDTH);
+            send_png_segment(local_mirror_set, local_mirror_elements / WIDTH);
+        } else {
+
+            FILE *fp = fopen(filename, "wb");
+            if (!fp) {
+                fprintf(stderr, "Error opening file for writing\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+
+            // Signature and header, with the same 8-bit colour type libpng writes in the other modes
+            static const unsigned char signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+            unsigned char header[13] = {(WIDTH >> 24) & 255, (WIDTH >> 16) & 255, (WIDTH >> 8) & 255, WIDTH & 255,
+                                        (HEIGHT >> 24) & 255, (HEIGHT >> 16) & 255, (HEIGHT >> 8) & 255, HEIGHT & 255, 8, png_color_type, 0, 0, 0};
+            int error = fwrite(signature, 1, sizeof(signature), fp) != sizeof(signature);
+            error |= write_png_chunk(fp, "IHDR", header, sizeof(header));
+
+            // The palette goes between the header and the image data (png_color is 3 packed bytes)
+            if (png_color_type == PNG_COLOR_TYPE_PALETTE) {
+                error |= write_png_chunk(fp, "PLTE", (const unsigned char *)png_palette, 3 * png_palette_size);
+            }
+
+            // The zlib header goes in front of the first segment (0x789c is a multiple of 31, as required)
+            static const unsigned char zlib_header[2] = {0x78, 0x9c};
+            error |= write_png_chunk(fp, "IDAT", zlib_header, sizeof(zlib_header));
+
+            unsigned long adler = adler32(0L, Z_NULL, 0);
+            for (int i = 0; i < size; i++) {
+                error |= write_png_segment(fp, local_julia_set, local_total_elements / WIDTH, i, &adler);
+            }
+            for (int i = size - 1; i >= 0; i--) {
+                error |= write_png_segment(fp, local_mirror_set, local_mirror_elements / WIDTH, i, &adler);
+            }
+
+            // Every segment ends on a sync flush, so a final empty fixed-Huffman block closes the
+            // stream. The Adler-32 of the whole stream follows, combined from the segments' checksums
+            unsigned char trailer[6] = {0x03, 0x00, adler >> 24, adler >> 16, adler >> 8, adler & 255};
+            error |= write_png_chunk(fp, "IDAT", trailer, sizeof(trailer));
+            error |= write_png_chunk(fp, "IEND", NULL, 0);
+            encoded_bytes = ftell(fp);
+            error |= fclose(fp) != 0;
+            if (error) {
+                fprintf(stderr, "Error during PNG creation\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
 
-        // Create PNG structures
-        png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-        if (!png_ptr) {
-            fclose(fp);
-            fprintf(stderr, "Error creating PNG write structure\n");
-            return 1;
+            // Print success message
+            printf("\nPNG image created successfully: %s \n", filename);
         }
 
-        png_infop info_ptr = png_create_info_struct(png_ptr);
-        if (!info_ptr) {
-            png_destroy_write_struct(&png_ptr, NULL);
-            fclose(fp);
-            fprintf(stderr, "Error creating PNG info structure\n");
-            return 1;
+        free(local_julia_set);
+        free(local_mirror_set);
+        free(chunk_rows);
+        free(tiles);
+
+    } else if (GIGAPIXEL_MODE && rank != 0) {
+
+        // The chunks are computed and sent one by one
+        send_gigapixel_chunks(rank, size, &reference, &compute_time, &local_rows);
+        free(local_julia_set);
+        free(local_mirror_set);
+
+    } else if (rank != 0) {
+
+        // In the dynamic schedule, first tell rank 0 where the rows or tiles go
+        if (tiled && ROW_SCHEDULE == 1) {
+            MPI_Send(&tile_count, 1, MPI_INT, 0, 4, MPI_COMM_WORLD);
+            MPI_Send(tiles, tile_count, MPI_INT, 0, 5, MPI_COMM_WORLD);
+        } else if (ROW_SCHEDULE == 1) {
+            MPI_Send(&chunk_count, 1, MPI_INT, 0, 4, MPI_COMM_WORLD);
+            MPI_Send(chunk_rows, chunk_count, MPI_INT, 0, 5, MPI_COMM_WORLD);
         }
 
-        // Error handling setup
-        if (setjmp(png_jmpbuf(png_ptr))) {
-            png_destroy_write_struct(&png_ptr, &info_ptr);
-            fclose(fp);
-            fprintf(stderr, "Error during PNG creation\n");
-            return 1;
+        if (streamed && (ROW_SCHEDULE == 1 || ROW_SCHEDULE == 2)) {
+
+            // Each chunk, then its mirrored rows, goes out as rank 0 grants credits for it
+            send_streamed_chunks(local_julia_set, chunk_rows, chunk_count, mirrored_chunks ? local_mirror_set : NULL, unique_rows);
+
+        } else if (streamed) {
+
+            // Both sizes go first, then the rows follow as rank 0 grants credits
+            MPI_Send(&local_total_elements, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
+            MPI_Send(&local_mirror_elements, 1, MPI_INT, 0, 2, MPI_COMM_WORLD);
+            send_streamed_rows(local_julia_set, local_total_elements / WIDTH);
+            send_streamed_rows(local_mirror_set, local_mirror_elements / WIDTH);
+
+        } else {
+
+            // Send local_julia_set size (consider uneven distribution)
+            MPI_Send(&local_total_elements, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
+            MPI_Send(local_julia_set, local_total_elements, MPI_INT, 0, 1, MPI_COMM_WORLD);
+
+            // Followed by the mirrored rows, which may be empty
+            MPI_Send(&local_mirror_elements, 1, MPI_INT, 0, 2, MPI_COMM_WORLD);
+            MPI_Send(local_mirror_set, local_mirror_elements, MPI_INT, 0, 3, MPI_COMM_WORLD);
         }
 
-        // Set image properties
-        png_set_IHDR(png_ptr, info_ptr, WIDTH, HEIGHT, 8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE,
-                    PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_BASE);
+        free(local_julia_set);
+        free(local_mirror_set);
+        free(chunk_rows);
+        free(tiles);
 
-        // Initialize I/O for writing to file
-        png_init_io(png_ptr, fp);
+    } else { // Root process receives from all processes
 
-        // Write PNG header (including all required information)
-        png_write_info(png_ptr, info_ptr);
+        // Open the file and write its header
+        ImageEncoder encoder;
+        if (open_image_encoder(&encoder, filename, WIDTH, HEIGHT)) {
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
 
         // Initialize current pixel count
         unsigned long long current_pixel = 0; 
         int* array;
         int received_size;
 
-        for (int i = 0; i < size; i++) {
+        // Allocate memory for one row of image data
+        png_bytep image_data = (png_bytep)malloc(WIDTH * 4 * sizeof(png_byte)); // 4 bytes per pixel for RGBA
+
+        if (!image_data) {
+            fprintf(stderr, "Error allocating memory for image data\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        if (GIGAPIXEL_MODE) {
 
-            if (i == 0){
-                
-                array = local_julia_set;
-                received_size = local_total_elements;
+            // Rank 0 computes its own chunks between writing the others
+            write_gigapixel_chunks(&encoder, size, &reference, image_data, &current_pixel, &compute_time, &local_rows);
+            free(local_julia_set);
+            free(local_mirror_set);
 
-            } else {
+        } else if (streamed && (ROW_SCHEDULE == 1 || ROW_SCHEDULE == 2)) {
 
-                // Allocate memory for received data
-                received_size;
-                MPI_Recv(&received_size, 1, MPI_INT, i, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            // Chunks arrive a few rows at a time in file order, into a fixed set of buffers
+            write_streamed_chunks(&encoder, size, unique_rows, mirrored_chunks, local_julia_set, chunk_rows, chunk_count, local_mirror_set,
+                                  image_data, &current_pixel);
+            free(local_julia_set);
+            free(local_mirror_set);
+            free(chunk_rows);
+            free(tiles);
 
-                array = malloc(sizeof(int) * received_size);
-                MPI_Recv(array, received_size, MPI_INT, i, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        } else if (tiled || ROW_SCHEDULE == 1 || ROW_SCHEDULE == 2) {
 
+            // Chunks and tiles arrive grouped by rank, so put all of them in place before writing any row
+            int *image = malloc(sizeof(int) * WIDTH * unique_rows);
+            if (!image) {
+                fprintf(stderr, "Error allocating memory for image data\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+
+            for (int i = 0; i < size; i++) {
+
+                if (i == 0) {
+
+                    if (tiled) {
+                        place_tiles(image, unique_rows, local_julia_set, tiles, tile_count);
+                    } else {
+                        place_row_chunks(image, unique_rows, local_julia_set, chunk_rows, chunk_count);
+                    }
+                    free(local_julia_set);
+                    free(chunk_rows);
+                    free(tiles);
+
+                } else {
+
+                    // The dynamic schedule sends its chunk or tile list, the others are known
+                    int *received_list;
+                    int received_count;
+                    if (ROW_SCHEDULE == 1) {
+                        MPI_Recv(&received_count, 1, MPI_INT, i, 4, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                        received_list = malloc(sizeof(int) * (received_count > 0 ? received_count : 1));
+                        MPI_Recv(received_list, received_count, MPI_INT, i, 5, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                    } else if (tiled) {
+                        received_list = assigned_tiles(i, size, unique_rows, &received_count);
+                    } else {
+                        received_list = block_cyclic_chunk_rows(i, size, unique_rows, &received_count);
+                    }
+
+                    // Receive the rows or tiles straight into their places in the image
+                    MPI_Datatype pixels_type = tiled ? tiles_type(unique_rows, received_list, received_count)
+                                                     : row_chunks_type(unique_rows, received_list, received_count);
+                    MPI_Recv(&received_size, 1, MPI_INT, i, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                    MPI_Recv(image, 1, pixels_type, i, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                    MPI_Type_free(&pixels_type);
+                    free(received_list);
+
+                    // The mirrored rows of other ranks are empty in these schedules
+                    int empty_mirror[1];
+                    MPI_Recv(&received_size, 1, MPI_INT, i, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                    MPI_Recv(empty_mirror, received_size, MPI_INT, i, 3, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                }
             }
 
-            // Allocate memory for section of image data
-            png_bytep image_data = (png_bytep)malloc(received_size * 4 * sizeof(png_byte)); // 4 bytes per pixel for RGBA
+            write_image_rows(&encoder, image, unique_rows, image_data, &current_pixel);
 
-            if (!image_data) {
+            // Mirrored rows are copied from the assembled rows
+            int mirror_rows = HEIGHT - unique_rows;
+            free(local_mirror_set);
+            array = malloc(sizeof(int) * WIDTH * (mirror_rows > 0 ? mirror_rows : 1));
+            if (!array) {
                 fprintf(stderr, "Error allocating memory for image data\n");
-                png_destroy_write_struct(&png_ptr, &info_ptr);
-                fclose(fp);
-                return 1;
+                MPI_Abort(MPI_COMM_WORLD, 1);
             }
+            mirror_julia_rows(WIDTH, 0, unique_rows, HEIGHT, image, array, REAL_NUMBER, IMAGINARY_NUMBER);
+            write_image_rows(&encoder, array, mirror_rows, image_data, &current_pixel);
+            free(array);
+            free(image);
 
-            // Fill image data with solid blue color
-            for (int y = 0; y < (received_size/WIDTH); y++) {
-                for (int x = 0; x < WIDTH; x++) {
+        } else if (streamed) {
 
-                    // Get pixel colour
-                    int red, green, blue;
-                    map_to_color(array[y * WIDTH + x], &red, &green, &blue, COLOR_CHOICE);
+            // Rows arrive a few at a time into a fixed set of buffers
+            write_streamed_strips(&encoder, size, local_julia_set, local_total_elements / WIDTH, local_mirror_set, local_mirror_elements / WIDTH,
+                                  image_data, &current_pixel);
+            free(local_julia_set);
+            free(local_mirror_set);
 
-                    // Calculate offset for pixel
-                    int offset = x * 4; // 4 bytes per pixel
+        } else {
+
+            // Strip sizes of every rank, and the strips received so far. A strip moves from
+            // 0 (size pending) to 1 (size known), 2 (receive posted) and 3 (received)
+            int *strip_sizes = calloc(size, sizeof(int));
+            int **strips = calloc(size, sizeof(int *));
+            int *strip_states = calloc(size, sizeof(int));
+            MPI_Request *requests = malloc(sizeof(MPI_Request) * 2 * size);
+            if (!strip_sizes || !strips || !strip_states || !requests) {
+                fprintf(stderr, "Error allocating memory for image data\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
 
-                    // Assign RGBA values to image data
-                    image_data[offset] = red;         // Red
-                    image_data[offset + 1] = green;   // Green
-                    image_data[offset + 2] = blue;    // Blue
-                    image_data[offset + 3] = 255;     // Alpha (fully opaque)
+            // requests[i] receives the size of rank i's strip, requests[size + i] the strip itself
+            for (int i = 0; i < size; i++) {
+                requests[i] = requests[size + i] = MPI_REQUEST_NULL;
+                if (i > 0) {
+                    MPI_Irecv(&strip_sizes[i], 1, MPI_INT, i, 0, MPI_COMM_WORLD, &requests[i]);
+                }
+            }
 
-                    // Increment current pixel count
-                    current_pixel++;
+            // Rank 0's own rows come first, while the other strips are on their way
+            write_image_rows(&encoder, local_julia_set, local_total_elements / WIDTH, image_data, &current_pixel);
+            free(local_julia_set);
+
+            // Strips held for later ranks, received or with their receive posted
+            int held_strips = 0;
+            int next_rank = 1;
+            while (next_rank < size) {
+
+                // Post the receive of every strip whose size is known while the reorder buffer has
+                // room. The next strip in order is always posted, so the buffer cannot stall it
+                for (int i = next_rank; i < size; i++) {
+                    if (strip_states[i] == 1 && (i == next_rank || held_strips < GATHER_REORDER_STRIPS)) {
+                        strips[i] = malloc(sizeof(int) * (strip_sizes[i] > 0 ? strip_sizes[i] : 1));
+                        if (!strips[i]) {
+                            fprintf(stderr, "Error allocating memory for image data\n");
+                            MPI_Abort(MPI_COMM_WORLD, 1);
+                        }
+                        MPI_Irecv(strips[i], strip_sizes[i], MPI_INT, i, 1, MPI_COMM_WORLD, &requests[size + i]);
+                        strip_states[i] = 2;
+                        held_strips += i != next_rank;
+                    }
+                }
 
-                    // Print progress percentage
-                    if (current_pixel % (WIDTH / 10) == 0){
-                        printf("\rPNG Pixel Progress: %.2f%% Pixel Count: %llu", (double)current_pixel / ((double)WIDTH * HEIGHT) * 100, current_pixel);
+                // Write the next strip as soon as it is complete, then move the one after it out
+                // of the reorder buffer
+                if (strip_states[next_rank] == 3) {
+                    write_image_rows(&encoder, strips[next_rank], strip_sizes[next_rank] / WIDTH, image_data, &current_pixel);
+                    free(strips[next_rank]);
+                    next_rank++;
+                    if (next_rank < size && strip_states[next_rank] >= 2) {
+                        held_strips--;
                     }
+                    continue;
                 }
 
-                // Write current row to PNG
-                png_write_row(png_ptr, &image_data[0]);
+                // Otherwise wait for whichever size or strip arrives first
+                int index;
+                MPI_Waitany(2 * size, requests, &index, MPI_STATUS_IGNORE);
+                strip_states[index % size]++;
             }
 
-            free(image_data);
-            free(array);
+            free(strip_sizes);
+            free(strips);
+            free(strip_states);
+            free(requests);
+
+            // Mirrored rows run the other way, so the last rank holds the first of them
+            for (int i = size - 1; i >= 0; i--) {
+
+                if (i == 0){
+
+                    array = local_mirror_set;
+                    received_size = local_mirror_elements;
+
+                } else {
+
+                    MPI_Recv(&received_size, 1, MPI_INT, i, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+                    array = malloc(sizeof(int) * (received_size > 0 ? received_size : 1));
+                    MPI_Recv(array, received_size, MPI_INT, i, 3, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+                }
+
+                write_image_rows(&encoder, array, received_size / WIDTH, image_data, &current_pixel);
+                free(array);
+            }
         }
 
+        free(image_data);
+
         // Print newline after progress percentage  
         printf("\n");
 
-        // Write the end of the PNG information
-        png_write_end(png_ptr, info_ptr);
-
-        // Clean up
-        png_destroy_write_struct(&png_ptr, &info_ptr);
-        fclose(fp);
+        // Write the end of the image and close the file
+        if (close_image_encoder(&encoder)) {
+            fprintf(stderr, "Error during image creation\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
 
         // Print success message
-        printf("\nPNG image created successfully: %s \n", filename);
+        printf("\nImage created successfully: %s \n", filename);
 
     }
 
@@ -603,6 +2971,50 @@ int main(int argc, char *argv[]) {
     // Calculate the elapsed time
     elapsed_time = end_time - start_time;
 
+    // Compute time and row count of every rank, to show how even the row schedule is
+    double *compute_times = malloc(sizeof(double) * size);
+    int *row_counts = malloc(sizeof(int) * size);
+    if (compute_times == NULL || row_counts == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Gather(&compute_time, 1, MPI_DOUBLE, compute_times, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Gather(&local_rows, 1, MPI_INT, row_counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    // Total number of pixels the periodicity check resolved early
+    long long total_periodicity_resolved_pixels = 0;
+    MPI_Reduce(&periodicity_resolved_pixels, &total_periodicity_resolved_pixels, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    // Total number of pixels the attracting cycle trap resolved early
+    long long total_trap_resolved_pixels = 0;
+    MPI_Reduce(&trap_resolved_pixels, &total_trap_resolved_pixels, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    // Totals for the Mariani-Silver engine
+    long long total_filled_pixels = 0, total_guard_failures = 0;
+    MPI_Reduce(&mariani_silver_filled_pixels, &total_filled_pixels, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&mariani_silver_guard_failures, &total_guard_failures, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    free(reference.real);
+    free(reference.imag);
+
+    // Totals for the deep zoom engine
+    long long total_extra_references = 0, total_unresolved_glitches = 0;
+    MPI_Reduce(&deep_zoom_extra_references, &total_extra_references, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&deep_zoom_unresolved_glitches, &total_unresolved_glitches, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    // Pixels encoded on all ranks, and the longest any rank spent encoding
+    long long total_encoded_pixels;
+    double longest_encode_time;
+    MPI_Reduce(&encoded_pixels, &total_encoded_pixels, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&encode_time, &longest_encode_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    // Size of the files on all ranks, and the tiles and time of the DZI pyramid
+    long long total_encoded_bytes, total_dzi_tiles;
+    double longest_dzi_time;
+    MPI_Reduce(&encoded_bytes, &total_encoded_bytes, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&dzi_tiles, &total_dzi_tiles, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&dzi_time, &longest_dzi_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
     MPI_Finalize();
 
     // if rank is 0, print out the time analysis for merging arrays
@@ -612,9 +3024,62 @@ int main(int argc, char *argv[]) {
         printf("Total computation time: %e seconds\n", elapsed_time);
         printf("Computation time per process: %e seconds\n", elapsed_time / size);
         printf("Resolution of MPI_Wtime: %e seconds\n", tick);
+        if (DEEP_ZOOM) {
+            printf("Deep zoom: radius %e, reference orbit %d iterations, %d skipped by series approximation\n", DEEP_ZOOM_RADIUS, reference.length, reference.skip);
+            printf("Deep zoom: %lld extra references for glitches, %lld glitched pixels unresolved\n", total_extra_references, total_unresolved_glitches);
+        }
+        if (RANK_TIMING) {
+            double longest = 0.0, total = 0.0;
+            for (int i = 0; i < size; i++) {
+                printf("Rank %d: %d rows computed in %e seconds\n", i, row_counts[i], compute_times[i]);
+                longest = compute_times[i] > longest ? compute_times[i] : longest;
+                total += compute_times[i];
+            }
+            printf("Row schedule %d: slowest rank %e seconds, mean %e seconds, imbalance %.2f\n", ROW_SCHEDULE, longest, total / size, longest / (total / size));
+            if (ROW_SCHEDULE == 3 && !DEEP_ZOOM && !tiled) {
+                printf("Row schedule 3: cost preview took %e seconds on rank 0\n", planning_time);
+            }
+        }
+        if (MARIANI_SILVER) {
+            printf("Pixels filled by Mariani-Silver subdivision: %lld of %lld (%lld guard samples disagreed with their border)\n", total_filled_pixels, (long long)WIDTH * HEIGHT, total_guard_failures);
+        }
+        if (tiled) {
+            printf("Tile decomposition: %d tiles of %dx%d\n", tile_total(unique_rows), TILE_WIDTH, TILE_HEIGHT);
+        }
+        if (PALETTE_OUTPUT) {
+            if (png_color_type == PNG_COLOR_TYPE_PALETTE) {
+                printf("Palette output: %d colours, 1 byte per pixel\n", png_palette_size);
+            } else if (png_color_type == PNG_COLOR_TYPE_RGB) {
+                printf("Palette output: more than 256 colours, wrote RGB without alpha\n");
+            }
+        }
+        if (!mpi_io) {
+            printf("Encoder %s: %lld pixels in %e seconds on the busiest rank, %.1f megapixels per second, %lld bytes\n",
+                   parallel_deflate ? "parallel deflate" : image_encoder_names[IMAGE_ENCODER], total_encoded_pixels, longest_encode_time,
+                   total_encoded_pixels / longest_encode_time / 1e6, total_encoded_bytes);
+        }
+        if (dzi) {
+            printf("DZI output: %d levels, %lld tiles of %d pixels with an overlap of %d, pyramid built in %e seconds on the busiest rank\n",
+                   dzi_levels, total_dzi_tiles, DZI_TILE_SIZE, DZI_OVERLAP, longest_dzi_time);
+        }
+        if (symmetric) {
+            printf("Symmetry mode: computed the bottom half and mirrored the rest\n");
+        }
+        if (PERIODICITY_CHECK) {
+            printf("Pixels resolved early by periodicity check: %lld of %lld\n", total_periodicity_resolved_pixels, (long long)WIDTH * HEIGHT);
+        }
+        if (ATTRACTING_CYCLE_TRAP && julia_cycle.found) {
+            printf("Attracting cycle: period %d, multiplier %f, trap radius %e\n", julia_cycle.period, julia_cycle.multiplier, julia_cycle.radius);
+            printf("Pixels resolved early by attracting cycle trap: %lld of %lld\n", total_trap_resolved_pixels, (long long)WIDTH * HEIGHT);
+        } else if (ATTRACTING_CYCLE_TRAP) {
+            printf("Attracting cycle: none found, trap disabled\n");
+        }
         printf("%d,%d,%d,%e,%e,%e,%f,%f",WIDTH, HEIGHT, size, elapsed_time, (elapsed_time / size), tick, REAL_NUMBER, IMAGINARY_NUMBER);
     }
 
+    free(compute_times);
+    free(row_counts);
+
     return 0;
 
 }
@@ -5,6 +5,7 @@
 #include <unistd.h> // Needed for usleep function
 #include <time.h> // Needed for time functions
 #include <math.h>
+#include <string.h>
 #include <png.h>
 
 #ifndef M_PI
@@ -17,12 +18,92 @@
 
 #define COLOR_CHOICE 1
 
+// Skip the iteration loop for points inside the main cardioid or period-2 bulb (1 = on, 0 = off)
+#define CARDIOID_CHECK 1
+
+// Rows per message when the strips are streamed to rank 0. A rank sends each message only once rank 0
+// has granted it a credit, which rank 0 does when one of its STREAM_CREDITS reusable buffers is free,
+// so the memory of rank 0 holds its own strip and these buffers, however large the image
+#define STREAM_ROWS 64
+#define STREAM_CREDITS 4
+
+// Encoder of the image file (0 = libpng, 1 = libpng fast preset, 2 = QOI, 3 = JPEG preview, 4 = PPM).
+// The fast preset is zlib level 1 with run-length matching and the Sub filter, for intermediate renders
+// where wall time matters more than size. JPEG needs -ljpeg. PPM is binary RGB without compression
+#define IMAGE_ENCODER 0
+
+// zlib level (0 to 9), zlib strategy (0 = default, 1 = filtered, 2 = Huffman only, 3 = run-length) and
+// row filters (PNG_FILTER_* flags) of IMAGE_ENCODER 0. -1 keeps libpng's choice
+#define PNG_ZLIB_LEVEL -1
+#define PNG_ZLIB_STRATEGY -1
+#define PNG_ROW_FILTERS -1
+
+// Quality of IMAGE_ENCODER 3 (1 to 100)
+#define JPEG_QUALITY 85
+
+#include "image_encoder.h"
+
 void calculate_mandelbrot_array(int width, int height, int *result);
 void calculate_mandelbrot_array_range(int width, int start_row, int end_row, int *result);
-int generate_png(int width, int height, int array[], int color_choice);
+int in_main_cardioid_or_bulb(double x0, double y0);
+int generate_png(int width, int height, int array[], int rows, int size, int color_choice);
+void write_image_rows(ImageEncoder *encoder, const int *array, int rows, png_bytep image_data, unsigned long long *current_pixel, const png_byte *color_table);
+void send_streamed_rows(const int *array, int rows);
+void write_image_rows(ImageEncoder *encoder, const int *array, int rows, png_bytep image_data, unsigned long long *current_pixel, const png_byte *color_table) {
+
+    for (int y = 0; y < rows; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+
+            // Look the pixel colour up in the table
+            const png_byte *color = &color_table[array[y * WIDTH + x] * 4];
+
+            int offset = x * 4; // 4 bytes per pixel
+
+            image_data[offset] = color[0];       // Red
+            image_data[offset + 1] = color[1];   // Green
+            image_data[offset + 2] = color[2];   // Blue
+            image_data[offset + 3] = color[3];   // Alpha (fully opaque)
+
+            // Increment current pixel count
+            (*current_pixel)++;
+
+            if (*current_pixel % (WIDTH / 10) == 0){
+                printf("\rPNG Pixel Progress: %.2f%% Pixel Count: %llu", (double)*current_pixel / ((double)WIDTH * HEIGHT) * 100, *current_pixel);
+            }
+        }
+        if (encode_image_row(encoder, image_data)) {
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+}
+
+void send_streamed_rows(const int *array, int rows) {
+
+    // Every message waits for its credit, so it always meets a posted receive on rank 0 and never
+    // piles up there as an unexpected message
+    for (int row = 0; row < rows; row += STREAM_ROWS) {
+        int message_rows = rows - row < STREAM_ROWS ? rows - row : STREAM_ROWS;
+        MPI_Recv(NULL, 0, MPI_INT, 0, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Send(&array[row * WIDTH], message_rows * WIDTH, MPI_INT, 0, 1, MPI_COMM_WORLD);
+    }
+}
+
+void build_color_table(png_bytep color_table, int color_choice);
 void map_to_color(int iteration, int *red, int *green, int *blue, int color_choice);
 double hue_to_rgb(double hue, double saturation, double lightness);
 
+int in_main_cardioid_or_bulb(double x0, double y0) {
+
+    // Main cardioid: q * (q + (x - 1/4)) <= y^2 / 4 with q = (x - 1/4)^2 + y^2
+    double q = (x0 - 0.25) * (x0 - 0.25) + y0 * y0;
+    if (q * (q + (x0 - 0.25)) <= 0.25 * y0 * y0) {
+        return 1;
+    }
+
+    // Period-2 bulb: the disc of radius 1/4 centred on -1
+    return (x0 + 1.0) * (x0 + 1.0) + y0 * y0 <= 0.0625;
+}
+
 void calculate_mandelbrot_array(int width, int height, int *result) {
     double xmin = -2.0, xmax = 2.0, ymin = -2.0, ymax = 2.0;
     double xstep = (xmax - xmin) / width;
@@ -37,6 +118,11 @@ void calculate_mandelbrot_array(int width, int height, int *result) {
             double xx = 0.0, yy = 0.0;
             int iteration = 0;
 
+            // Points in the main cardioid or the period-2 bulb never escape, so skip straight to the limit
+            if (CARDIOID_CHECK && in_main_cardioid_or_bulb(x0, y0)) {
+                iteration = MAX_ITERATION;
+            }
+
             while (xx * xx + yy * yy <= 4.0 && iteration < MAX_ITERATION) {
                 double xtemp = xx * xx - yy * yy + x0;
                 yy = 2 * xx * yy + y0;
@@ -91,6 +177,11 @@ void calculate_mandelbrot_array_range(int width, int start_row, int end_row, int
             // Initialize the iteration count
             int iteration = 0;
 
+            // Points in the main cardioid or the period-2 bulb never escape, so skip straight to the limit
+            if (CARDIOID_CHECK && in_main_cardioid_or_bulb(x0, y0)) {
+                iteration = MAX_ITERATION;
+            }
+
             // Iterate until the magnitude of the complex number exceeds 2 or maximum iterations are reached
             while (xx * xx + yy * yy <= 4.0 && iteration < MAX_ITERATION) {
 
@@ -118,108 +209,140 @@ void calculate_mandelbrot_array_range(int width, int start_row, int end_row, int
 }
 
 
-int generate_png(int width, int height, int array[], int color_choice) {
+int generate_png(int width, int height, int array[], int rows, int size, int color_choice) {
 
     char filename[100]; // Buffer to hold the filename
 
     // Format the filename with height and width
-    snprintf(filename, sizeof(filename), "mandelbrot_%dx%d_color-%d_iterations-%d.png", WIDTH, HEIGHT, COLOR_CHOICE, MAX_ITERATION);
-
-    // Open file for writing (binary mode)
-    FILE *fp = fopen(filename, "wb");
-    if (!fp) {
-        fprintf(stderr, "Error opening file for writing\n");
-        return 1;
-    }
+    snprintf(filename, sizeof(filename), "mandelbrot_%dx%d_color-%d_iterations-%d.%s", WIDTH, HEIGHT, COLOR_CHOICE, MAX_ITERATION, image_extensions[IMAGE_ENCODER]);
 
-    // Create PNG structures
-    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (!png_ptr) {
-        fclose(fp);
-        fprintf(stderr, "Error creating PNG write structure\n");
+    // Open the encoder of IMAGE_ENCODER, which writes the file header
+    ImageEncoder encoder;
+    if (open_image_encoder(&encoder, filename, width, height)) {
         return 1;
     }
 
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr) {
-        png_destroy_write_struct(&png_ptr, NULL);
-        fclose(fp);
-        fprintf(stderr, "Error creating PNG info structure\n");
-        return 1;
-    }
-
-    // Error handling setup
-    if (setjmp(png_jmpbuf(png_ptr))) {
-        png_destroy_write_struct(&png_ptr, &info_ptr);
-        fclose(fp);
-        fprintf(stderr, "Error during PNG creation\n");
-        return 1;
-    }
-
-    // Set image properties
-    png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE,
-                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_BASE);
-
-    // Initialize I/O for writing to file
-    png_init_io(png_ptr, fp);
-
-    // Write PNG header (including all required information)
-    png_write_info(png_ptr, info_ptr);
-
     // Allocate memory for entire image data
     png_bytep image_data = (png_bytep)malloc(width * 4 * sizeof(png_byte)); // 4 bytes per pixel for RGBA
 
-    if (!image_data) {
+    // Colour table with the RGBA values of every iteration count, so no pixel runs map_to_color
+    png_bytep color_table = (png_bytep)malloc((MAX_ITERATION + 1) * 4 * sizeof(png_byte));
+
+    if (!image_data || !color_table) {
         fprintf(stderr, "Error allocating memory for image data\n");
-        png_destroy_write_struct(&png_ptr, &info_ptr);
-        fclose(fp);
+        close_image_encoder(&encoder);
         return 1;
     }
+    build_color_table(color_table, color_choice);
 
     // Initialize current pixel count
     unsigned long long current_pixel = 0; 
 
-    // Fill image data with solid blue color
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
+    // Strip sizes of the other ranks, which arrive as soon as they have finished computing
+    int *strip_sizes = calloc(size, sizeof(int));
+    MPI_Request *size_requests = malloc(sizeof(MPI_Request) * size);
+    int *buffers = malloc(sizeof(int) * STREAM_CREDITS * STREAM_ROWS * width);
+    if (!strip_sizes || !size_requests || !buffers) {
+        fprintf(stderr, "Error allocating memory for image data\n");
+        close_image_encoder(&encoder);
+        return 1;
+    }
+    for (int i = 1; i < size; i++) {
+        MPI_Irecv(&strip_sizes[i], 1, MPI_INT, i, 0, MPI_COMM_WORLD, &size_requests[i]);
+    }
 
-            // Get pixel colour
-            int red, green, blue;
-            map_to_color(array[y * width + x], &red, &green, &blue, color_choice);
+    // The buffers form a ring of messages in row order: the oldest at first_buffer, the others
+    // behind it with their receives posted and their credits granted
+    MPI_Request buffer_requests[STREAM_CREDITS];
+    int buffer_rows[STREAM_CREDITS];
+    int first_buffer = 0, buffers_in_use = 0;
+
+    // Credits are granted up to STREAM_CREDITS messages ahead of the writing, rank by rank
+    int source = 1, source_row = 0;
+    int own_rows_written = 0;
+    while (1) {
+
+        while (buffers_in_use < STREAM_CREDITS && source < size) {
+
+            // Move on to the next rank once its strip size is known. Only wait for the size when
+            // there is nothing to write in the meantime
+            int known;
+            MPI_Test(&size_requests[source], &known, MPI_STATUS_IGNORE);
+            if (!known && (buffers_in_use > 0 || !own_rows_written)) {
+                break;
+            }
+            if (!known) {
+                MPI_Wait(&size_requests[source], MPI_STATUS_IGNORE);
+            }
 
-            int offset = x * 4; // 4 bytes per pixel
+            int source_rows = strip_sizes[source] / width;
+            if (source_row >= source_rows) {
+                source++;
+                source_row = 0;
+                continue;
+            }
 
-            image_data[offset] = red;         // Red
-            image_data[offset + 1] = green;   // Green
-            image_data[offset + 2] = blue;    // Blue
-            image_data[offset + 3] = 255;     // Alpha (fully opaque)
+            int buffer = (first_buffer + buffers_in_use) % STREAM_CREDITS;
+            buffer_rows[buffer] = source_rows - source_row < STREAM_ROWS ? source_rows - source_row : STREAM_ROWS;
+            MPI_Irecv(&buffers[buffer * STREAM_ROWS * width], buffer_rows[buffer] * width, MPI_INT, source, 1, MPI_COMM_WORLD, &buffer_requests[buffer]);
+            MPI_Send(NULL, 0, MPI_INT, source, 2, MPI_COMM_WORLD);
+            buffers_in_use++;
+            source_row += buffer_rows[buffer];
+        }
 
-            // Increment current pixel count
-            current_pixel++;
+        // Rank 0's own rows come first, while the first messages are on their way
+        if (!own_rows_written) {
+            write_image_rows(&encoder, array, rows, image_data, &current_pixel, color_table);
+            own_rows_written = 1;
+        }
 
-            if (current_pixel % (WIDTH / 10) == 0){
-                printf("\rPNG Pixel Progress: %.2f%% Pixel Count: %llu", (double)current_pixel / ((double)width * height) * 100, current_pixel);
-            }
+        // With nothing in flight, either every strip is written or the next size has to be waited for
+        if (buffers_in_use == 0 && source == size) {
+            break;
+        }
+        if (buffers_in_use == 0) {
+            continue;
         }
-        png_write_row(png_ptr, &image_data[0]);
 
+        // Write the oldest message and hand its buffer to the next one
+        MPI_Wait(&buffer_requests[first_buffer], MPI_STATUS_IGNORE);
+        write_image_rows(&encoder, &buffers[first_buffer * STREAM_ROWS * width], buffer_rows[first_buffer], image_data, &current_pixel, color_table);
+        first_buffer = (first_buffer + 1) % STREAM_CREDITS;
+        buffers_in_use--;
     }
 
+    free(strip_sizes);
+    free(size_requests);
+    free(buffers);
+
     // new line after progress percentage 
     printf("\n");
 
-    // Write the end of the PNG information
-    png_write_end(png_ptr, info_ptr);
-
-    // Clean up
+    // Clean up, then write the end of the file
     free(image_data);
-    png_destroy_write_struct(&png_ptr, &info_ptr);
-    fclose(fp);
+    free(color_table);
+    if (close_image_encoder(&encoder)) {
+        fprintf(stderr, "Error writing image file\n");
+        return 1;
+    }
 
-    printf("PNG image created successfully: %s \n", filename);
+    printf("Image created successfully: %s \n", filename);
     return 0;
 }
 
+void build_color_table(png_bytep color_table, int color_choice) {
+
+    // Every pixel with the same iteration count gets the same colour, so each count is mapped once
+    for (int iteration = 0; iteration <= MAX_ITERATION; iteration++) {
+        int red, green, blue;
+        map_to_color(iteration, &red, &green, &blue, color_choice);
+        color_table[iteration * 4] = red;         // Red
+        color_table[iteration * 4 + 1] = green;   // Green
+        color_table[iteration * 4 + 2] = blue;    // Blue
+        color_table[iteration * 4 + 3] = 255;     // Alpha (fully opaque)
+    }
+}
+
 void map_to_color(int iteration, int *red, int *green, int *blue, int color_choice) {
     double t;
     double hue;
@@ -432,53 +555,24 @@ int main(int argc, char *argv[]) {
     // Generate the Mandelbrot set
     calculate_mandelbrot_array_range(WIDTH, start_row, end_row, local_mandelbrot_set);
 
-    // Root process pre-allocates final Mandelbrot set
-    int *final_mandelbrot_set;
-    if (rank == 0) {
-        final_mandelbrot_set = malloc(sizeof(int) * WIDTH * HEIGHT);
-        if (final_mandelbrot_set == NULL) {
-        fprintf(stderr, "Error: Memory allocation failed\n");
-        MPI_Finalize();
-        return 1;
-        }
-    }
-
     // Send and Receive local results (instead of Gather)
     if (rank != 0) {
 
-        // Send local_mandelbrot_set size (consider uneven distribution)
+        // Send local_mandelbrot_set size (consider uneven distribution), then the rows as rank 0 grants credits
         MPI_Send(&total_elements, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
-        MPI_Send(local_mandelbrot_set, total_elements, MPI_INT, 0, 1, MPI_COMM_WORLD);
-
-    } else { // Root process receives from all processes
-        
-        int offset = 0;
-
-        // Copy received data to final_mandelbrot_set at appropriate offset
-        memcpy(final_mandelbrot_set + offset, local_mandelbrot_set, sizeof(int) * total_elements);
-        offset += total_elements;
+        send_streamed_rows(local_mandelbrot_set, end_row - start_row);
 
-        for (int i = 1; i < size; i++) {
+    } else { // Root process writes its own rows, then receives the others a few at a time
 
-            // Allocate memory for received data
-            int received_size;
-            MPI_Recv(&received_size, 1, MPI_INT, i, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-            int *temp_buffer = malloc(sizeof(int) * received_size);
-            MPI_Recv(temp_buffer, received_size, MPI_INT, i, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-            // Copy received data to final_mandelbrot_set at appropriate offset
-            memcpy(final_mandelbrot_set + offset, temp_buffer, sizeof(int) * received_size);
-            offset += received_size;
-
-            free(temp_buffer); // Free temporary buffer if used
+        // The other ranks wait on credits from rank 0, so a failed file takes the whole job down
+        if (generate_png(WIDTH, HEIGHT, local_mandelbrot_set, end_row - start_row, size, COLOR_CHOICE)) {
+            MPI_Abort(MPI_COMM_WORLD, 1);
         }
 
-        generate_png(WIDTH, HEIGHT, final_mandelbrot_set, COLOR_CHOICE);
-        free(final_mandelbrot_set);
-
     }
 
+    free(local_mandelbrot_set);
+
     // Ensures all processes will enter the measured section of the code at the same time
     MPI_Barrier(MPI_COMM_WORLD);
 
@@ -496,6 +590,8 @@ int main(int argc, char *argv[]) {
         printf("Total computation time: %e seconds\n", elapsed_time);
         printf("Computation time per process: %e seconds\n", elapsed_time / size);
         printf("Resolution of MPI_Wtime: %e seconds\n", tick);
+        printf("Encoder %s: %lld pixels in %e seconds, %.1f megapixels per second, %lld bytes\n", image_encoder_names[IMAGE_ENCODER],
+               encoded_pixels, encode_time, encoded_pixels / encode_time / 1e6, encoded_bytes);
     }
 
     return 0;
@@ -3,6 +3,7 @@
 #include <unistd.h>
 #include <time.h>
 #include <math.h>
+#include <string.h>
 #include <png.h>
 
 #ifndef M_PI
@@ -20,12 +21,29 @@
 // 14 are a bit odd 
 #define COLOR_CHOICE 16
 
+// Encoder of the image file (0 = libpng, 1 = libpng fast preset, 2 = QOI, 3 = JPEG preview, 4 = PPM).
+// The fast preset is zlib level 1 with run-length matching and the Sub filter, for intermediate renders
+// where wall time matters more than size. JPEG needs -ljpeg. PPM is binary RGB without compression
+#define IMAGE_ENCODER 0
+
+// zlib level (0 to 9), zlib strategy (0 = default, 1 = filtered, 2 = Huffman only, 3 = run-length) and
+// row filters (PNG_FILTER_* flags) of IMAGE_ENCODER 0. -1 keeps libpng's choice
+#define PNG_ZLIB_LEVEL -1
+#define PNG_ZLIB_STRATEGY -1
+#define PNG_ROW_FILTERS -1
+
+// Quality of IMAGE_ENCODER 3 (1 to 100)
+#define JPEG_QUALITY 85
+
+#include "image_encoder.h"
+
 typedef struct {
     double real;
     double imag;
 } Complex;
 
 int generate_png(int width, int height, int color_choice, double real, double imaginary);
+void build_color_table(png_bytep color_table, int color_choice);
 void map_to_color(int iteration, int *red, int *green, int *blue, int color_choice);
 double hue_to_rgb(double hue, double saturation, double lightness);
 
@@ -35,58 +53,28 @@ int generate_png(int width, int height, int color_choice, double real, double im
     char filename[100]; 
 
     // Format the filename with height, width, color choice, and maximum iteration
-    snprintf(filename, sizeof(filename), "julia-set_%dx%d_color-%d_iterations-%d_real-%f_imaginary-%f.png", width, height, color_choice, MAX_ITERATION, real, imaginary);
-
-    // Open file for writing (binary mode)
-    FILE *fp = fopen(filename, "wb");
-    if (!fp) {
-        fprintf(stderr, "Error opening file for writing\n");
-        return 1;
-    }
-
-    // Create PNG structures
-    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (!png_ptr) {
-        fclose(fp);
-        fprintf(stderr, "Error creating PNG write structure\n");
-        return 1;
-    }
-
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr) {
-        png_destroy_write_struct(&png_ptr, NULL);
-        fclose(fp);
-        fprintf(stderr, "Error creating PNG info structure\n");
-        return 1;
-    }
+    snprintf(filename, sizeof(filename), "julia-set_%dx%d_color-%d_iterations-%d_real-%f_imaginary-%f.%s", width, height, color_choice, MAX_ITERATION, real, imaginary, image_extensions[IMAGE_ENCODER]);
 
-    // Error handling setup
-    if (setjmp(png_jmpbuf(png_ptr))) {
-        png_destroy_write_struct(&png_ptr, &info_ptr);
-        fclose(fp);
-        fprintf(stderr, "Error during PNG creation\n");
+    // Open the encoder of IMAGE_ENCODER, which writes the file header
+    ImageEncoder encoder;
+    if (open_image_encoder(&encoder, filename, width, height)) {
         return 1;
     }
 
-    // Set image properties
-    png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE,
-                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_BASE);
-
-    // Initialize I/O for writing to file
-    png_init_io(png_ptr, fp);
-
-    // Write PNG header (including all required information)
-    png_write_info(png_ptr, info_ptr);
-
     // Allocate memory for entire image data
     png_bytep image_data = (png_bytep)malloc(width * 4 * sizeof(png_byte)); // 4 bytes per pixel for RGBA
 
-    if (!image_data) {
+    // Colour table with the RGBA values of every iteration count
+    png_bytep color_table = (png_bytep)malloc((MAX_ITERATION + 1) * 4 * sizeof(png_byte));
+
+    if (!image_data || !color_table) {
         fprintf(stderr, "Error allocating memory for image data\n");
-        png_destroy_write_struct(&png_ptr, &info_ptr);
-        fclose(fp);
+        free(image_data);
+        free(color_table);
+        close_image_encoder(&encoder);
         return 1;
     }
+    build_color_table(color_table, color_choice);
 
     int result;
 
@@ -98,15 +86,15 @@ int generate_png(int width, int height, int color_choice, double real, double im
 
     // Generate the Julia set and PNG image
     // Iterate through each pixel and calculate the Julia set value
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
 
             // Map pixel coordinates (x, y) directly to the rectangular region in the complex plane
             // The complex plane is mapped to a rectangular region defined by:
             // - Real part (x-axis): Range from -1.75 (leftmost) to 1.75 (rightmost)
             // - Imaginary part (y-axis): Range from -1.75 (bottom) to 1.75 (top)
             // The width and height of the rectangular region are adjusted to match the aspect ratio of the image.
-            Complex z = {.real = x / (double)WIDTH * 3.5 - 1.75, .imag = y / (double)HEIGHT * 3.5 - 1.75};
+            Complex z = {.real = x / (double)width * 3.5 - 1.75, .imag = y / (double)height * 3.5 - 1.75};
             int iteration = 0;
             while (z.real * z.real + z.imag * z.imag <= 4.0 && iteration < MAX_ITERATION) {
                 double temp = z.real * z.real - z.imag * z.imag + constant.real;
@@ -141,49 +129,65 @@ int generate_png(int width, int height, int color_choice, double real, double im
                 result = iteration;
             }
 
-            int red, green, blue;
-
-            // Map iteration count to RGB color
-            map_to_color(result, &red, &green, &blue, color_choice);
+            // Look the RGBA colour of the iteration count up in the table
+            png_bytep color = &color_table[result * 4];
 
             // Calculate offset for pixel
             int offset = x * 4; // 4 bytes per pixel 
 
             // Assign RGBA values to image data
-            image_data[offset] = red;         // Red
-            image_data[offset + 1] = green;   // Green
-            image_data[offset + 2] = blue;    // Blue
-            image_data[offset + 3] = 255;     // Alpha (fully opaque)
+            image_data[offset] = color[0];       // Red
+            image_data[offset + 1] = color[1];   // Green
+            image_data[offset + 2] = color[2];   // Blue
+            image_data[offset + 3] = color[3];   // Alpha (fully opaque)
 
             // Increment current pixel count
             current_pixel++;
 
             // Print progress percentage
-            if (current_pixel % (WIDTH / 10) == 0){
+            if (current_pixel % (width / 10) == 0){
                 printf("\rPNG Pixel Progress: %.2f%% Pixel Count: %llu", (double)current_pixel / ((double)width * height) * 100, current_pixel);
             }
         }
 
-        // Write current row to PNG
-        png_write_row(png_ptr, &image_data[0]);
+        // Hand the current row to the encoder
+        if (encode_image_row(&encoder, image_data)) {
+            free(image_data);
+            free(color_table);
+            close_image_encoder(&encoder);
+            return 1;
+        }
     }
 
     // Print newline after progress percentage  
     printf("\n");
 
-    // Write the end of the PNG information
-    png_write_end(png_ptr, info_ptr);
-
-    // Clean up
+    // Clean up, then write the end of the file
     free(image_data);
-    png_destroy_write_struct(&png_ptr, &info_ptr);
-    fclose(fp);
+    free(color_table);
+    if (close_image_encoder(&encoder)) {
+        fprintf(stderr, "Error writing image file\n");
+        return 1;
+    }
 
     // Print success message
-    printf("PNG image created successfully: %s \n", filename);
+    printf("Image created successfully: %s \n", filename);
     return 0;
 }
 
+void build_color_table(png_bytep color_table, int color_choice) {
+
+    // Every pixel with the same iteration count gets the same colour, so each count is mapped once
+    for (int iteration = 0; iteration <= MAX_ITERATION; iteration++) {
+        int red, green, blue;
+        map_to_color(iteration, &red, &green, &blue, color_choice);
+        color_table[iteration * 4] = red;         // Red
+        color_table[iteration * 4 + 1] = green;   // Green
+        color_table[iteration * 4 + 2] = blue;    // Blue
+        color_table[iteration * 4 + 3] = 255;     // Alpha (fully opaque)
+    }
+}
+
 void map_to_color(int iteration, int *red, int *green, int *blue, int color_choice) {
     double t;
     double hue;
@@ -549,6 +553,8 @@ int main() {
 
     // Print runtime in seconds
     printf("Runtime: %.3f seconds\n", elapsed_time);
+    printf("Encoder %s: %lld pixels in %e seconds, %.1f megapixels per second, %lld bytes\n", image_encoder_names[IMAGE_ENCODER],
+           encoded_pixels, encode_time, encoded_pixels / encode_time / 1e6, encoded_bytes);
 
     return 0;
 }
\ No newline at end of file